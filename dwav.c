@@ -11,65 +11,1123 @@
  * 
  */
 
+#define _GNU_SOURCE //CPU affinity and Linux memory policy calls
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdint.h>
 #include <fcntl.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <io.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#ifndef O_BINARY
+#define O_BINARY 0 //Only Windows distinguishes binary from text file handles
+#endif
 #define SUBCHUNKIDSIZE 4 //Size of the data subchunk's ID and Size fields
 #define FMTSUBCHUNKSIZENOPARAMS 16 //Size of the Format subchunk without any extra parameters
 #define DEFAULTINPUTFILENAME "input.wav"
 #define DEFAULTOUTPUTFILENAME "output.wav"
 #define VALIDEXTENSION ".wav"
-#define MAXEXTRASUBCHUNKS 10 //Number of "extra" subchunks (not riff, fmt, data) dWAV can process
-#define NUMVALIDFLAGS 5 
-char* VALIDFLAGS[NUMVALIDFLAGS] = {"-i", "-o", "-c", "-hz", "-r"}; //dWAV's supported flags
+#define MAXEXTRASUBCHUNKS 32 //Number of "extra" subchunks (not riff, fmt, data) dWAV can process
+#define CHUNKHEADERSIZE (sizeof(char[4]) + sizeof(int)) //Size of a subchunk's ID and Size fields
+#define BATCHOUTPUTSUFFIX "_out.wav" //Replaces ".wav" in each input filename in batch mode
+#define SEGMENTFILENAME "%.*s_%0*d.wav" //Output filename stem and number of a split segment
+enum flag { FLAGINPUT, FLAGOUTPUT, FLAGCOPY, FLAGSAMPLERATE, FLAGREVERSE, FLAGISA, FLAGBATCH,
+            FLAGJOBS, FLAGHUGETLB, FLAGPREFAULT, FLAGTIMING, FLAGNUMA, FLAGMAPPED, FLAGJSON,
+            FLAGIXML, FLAGTAG, FLAGEDIT, FLAGJUNK, FLAGSECTOR, FLAGDIRECT, FLAGTRIM, 
+            FLAGSPLITCUES, FLAGHIGHPASS, FLAGLOWPASS, FLAGLOWSHELF, FLAGHIGHSHELF, 
+            FLAGCONVOLVE, FLAGSPEED, FLAGLIMIT, FLAGCOMPRESS, FLAGUNLINKED, FLAGMIX, 
+            FLAGSPLITCHANNELS, FLAGMERGECHANNELS, FLAGCOMPARE, FLAGTOLERANCE, 
+            FLAGALIGN, FLAGANALYZE, FLAGREPACK, FLAGSPARSE, FLAGEDL, 
+            FLAGGAIN, FLAGVALIDATE, FLAGREPAIR, FLAGATOMIC, 
+            FLAGSYNC, NUMVALIDFLAGS };
+//dWAV's supported flags
+char* VALIDFLAGS[NUMVALIDFLAGS] = {"-i", "-o", "-c", "-hz", "-r", "-isa", "-b", "-j", "-hugetlb",
+                                   "-prefault", "-t", "-numa", "-mmap", "-json", "-ixml", "-tag",
+                                   "-edit", "-junk", "-sector", "-direct", "-trim", 
+                                   "-splitcues", "-hp", "-lp", "-ls", "-hs", 
+                                   "-conv", "-speed", "-limit", "-comp", "-unlinked", "-mix", 
+                                   "-splitch", "-mergech", "-cmp", "-tol", "-align", 
+                                   "-analyze", "-repack", "-sparse", "-edl", "-gain", 
+                                   "-validate", "-repair", "-atomic", "-sync"};
 
 struct riff { char chunkID[4]; int chunkSize; char format[4]; };
-struct fmt { char subChunk1ID[3]; int subChunk1Size; short audioForm, numChannels;
+struct fmt { char subChunk1ID[4]; int subChunk1Size; short audioForm, numChannels;
              int sampleRate, byteRate; short blockAlign, bitsPerSample; };
-struct data { char subChunk2ID[4]; int subChunk2Size; unsigned char subChunkData[1]; };
-struct wav { struct riff riffElements; struct fmt formatElements; struct data dataElements; };
-struct extraParams { short extraParamSize; int extraParams[1]; };
+//A subchunk's header, with its contents left in place in the file's memory
+struct data { char subChunk2ID[4]; int subChunk2Size; unsigned char* subChunkData; };
+//Where the frames of the data subchunk as it will be written come from in the input's data,
+//after the source frames were scaled in time by a factor, which stretching sets
+struct frameMap { size_t firstFrame, numFrames, sourceFrames; bool reversed; double scale; 
+                  bool endShared; }; //Positions at the end belong to the frames written next
+//A parsed .wav file. Every subchunk other than fmt is kept in file order around the data subchunk
+struct wav { struct riff riffElements; struct fmt formatElements; struct data dataElements;
+             unsigned char* extraParams; int extraParamsSize;
+             int numExtraSubChunks, numSubChunksBeforeData; 
+             struct data extraChunks[MAXEXTRASUBCHUNKS];
+             unsigned char* fileBytes; size_t fileLength; //The whole file as read or mapped
+             unsigned char* editedInfo; //LIST/INFO contents rebuilt by -tag, owned by the struct
+             struct data reservedJunk; //Header of the JUNK subchunk reserved by -junk
+             struct frameMap frames; //Built up by every transform that moves or cuts frames
+             bool samplesAltered; //The sample data in memory no longer matches the input file
+             unsigned char* remappedMarkers; //cue, smpl and LIST/adtl contents, owned
+             unsigned char* rebuiltData; //Sample data rebuilt by -speed or -repack, owned
+             unsigned char* repackedParams; }; //fmt extra parameters rebuilt by -repack, owned
 
+//The pieces of an output file in the order they are written. The sample data is marked so the
+//writers can transform it on the way out, and pieces without bytes are runs of zeros
+#define MAXOUTPUTPIECES (3 * MAXEXTRASUBCHUNKS + 8)
+#define CUEPOINTSIZE 24 //Size of one cue point in a cue subchunk
+#define SMPLHEADERSIZE 36 //Size of a smpl subchunk before its sample loops
+#define SMPLLOOPSIZE 24 //Size of one sample loop in a smpl subchunk
+struct outputPiece { const unsigned char* bytes; size_t length; bool isSampleData; };
+
+//Metadata editing. -tag sets LIST/INFO tags in the output file; with -edit they are instead
+//rewritten in place in the input file, inside the space of the old LIST subchunk and any padding
+//subchunks right after it, so only a few kilobytes are touched
+#define MAXTAGEDITS 32
+struct tagEdit { char tagID[4]; const char* value; };
+struct tagEdit tagEdits[MAXTAGEDITS];
+int numTagEdits = 0;
+bool editInPlace = false;
+int junkReservation = -1; //Size of the JUNK subchunk placed before data by -junk, if any
+int sectorAlignment = 0; //Boundary the data payload is padded to by -sector, if any
+
+//Reports print as labelled text, or with -json as one JSON object per file on a single line
+struct report { bool json, needsComma; };
+bool jsonReport = false;
+bool fullIXML = false; //Print the whole iXML payload instead of a few well-known fields
+#define BEXTSIZE 602 //Size of the fixed part of a bext chunk, up to the coding history
+#define IXMLFIELDS { "PROJECT", "SCENE", "TAKE", "TAPE", "NOTE" }
+#define NUMIXMLFIELDS 5
+#define NUMINFOTAGS 14
+const char* INFOTAGS[NUMINFOTAGS][2] = {
+   {"INAM", "Title"}, {"IART", "Artist"}, {"IPRD", "Product"}, {"ICMT", "Comments"}, 
+   {"ICOP", "Copyright"}, {"ICRD", "Creation Date"}, {"IGNR", "Genre"}, {"IENG", "Engineer"},
+   {"ITCH", "Technician"}, {"ISFT", "Software"}, {"IKEY", "Keywords"}, {"ISBJ", "Subject"},
+   {"ISRC", "Source"}, {"ITRK", "Track"}
+};
+
+//Reusable page-aligned buffers. Each worker owns one pool and hands its buffers back after every
+//job, so batch runs reuse memory whose pages are already faulted in instead of mapping fresh
+//memory per file
+#define MAXPOOLBUFFERS 8
+#define POOLPAGESIZE 4096
+#define POOLHUGEPAGESIZE (2 * 1024 * 1024) //Buffers at least this large are huge-page backed
+struct poolBuffer { void* memory; size_t capacity; bool inUse; };
+struct bufferPool { struct poolBuffer buffers[MAXPOOLBUFFERS]; int numBuffers; };
+struct fileRead { int filehandle; char* memory; size_t length, alignment, bytesRead; 
+                  pthread_mutex_t lock; };
+#define DIRECTIOALIGNMENT 4096 //Offset, length and buffer alignment required by O_DIRECT reads
+bool directInput = false; //Read input files with O_DIRECT, bypassing the page cache
+bool explicitHugePages = false; //Back huge buffers with hugetlbfs pages instead of advising THP
+bool prefaultBuffers = false; //Fault every page of a new buffer in when it is mapped
+
+//Mapped mode: the input file is mapped instead of read, and the output file is sized up front and
+//mapped shared so the final transform writes its result straight into the output file's pages
+bool mappedOutput = false;
+
+//Sparse output: runs of whole pages of silence in the sample data are seeked over, or punched out
+//of mapped output, and left as holes that read back as zeros
+bool sparseOutput = false;
+#define SPARSEPAGESIZE 4096 //Holes start and end on file blocks of this size
+#define SPARSEMINBYTES (64 * 1024) //Shorter runs are written, so files are not cut into fragments
+//Atomic output: every output is written under a temporary name and renamed into place when done.
+//With -sync, finished outputs are held open and synced in groups before they are renamed
+bool atomicOutput = false; 
+bool syncOutput = false; 
+#define TEMPEXTENSION ".tmp" //Appended to an output filename while the output is written
+#define SYNCGROUPFILES 64 //Finished outputs held before the group is synced and renamed
+#define SYNCWORKERS 16 //Most files of a group flushed at once
+struct outputGroup { int filehandles[SYNCGROUPFILES]; char* filenames[SYNCGROUPFILES]; 
+                     bool synced[SYNCGROUPFILES]; int numFiles; };
+struct outputGroup pendingOutputs = { .numFiles = 0 };
+pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER; 
+struct mappedCopy { unsigned char* dst; const unsigned char* src; size_t numFrames; 
+                    const struct sampleKernels* kernels; int kernelWidth; bool reversed; };
+
+//Split mode: the output is cut at every cue point into numbered files, written concurrently. The
+//input is mapped, and segments that are not transformed are copied file to file by the kernel
+bool splitAtCues = false;
+struct split { char* outputfilename; struct wav* pSoundFile; size_t* boundaries; 
+               int numSegments, nextSegment, inputfilehandle; bool reversed; 
+               pthread_mutex_t lock; };
+
+//NUMA placement. With -numa, every worker thread is bound to a node's CPUs and the slice of a
+//buffer it works on is placed in that node's memory
+#define MAXNUMANODES 64
+#define NUMANODEPATH "/sys/devices/system/node/node%d/cpulist"
+struct numaTopology { int numNodes; 
+#ifdef __linux__
+                      cpu_set_t cpus[MAXNUMANODES];
+#endif
+                    };
+bool numaAware = false;
+struct numaTopology numaNodes = { .numNodes = 1 };
+
+//Runs one body on several threads at once. Worker w handles share w of numWorkers shares
+struct parallelTask { void (*body)(void* context, int worker, int numWorkers); void* context;
+                      int worker, numWorkers; long minorFaults, majorFaults; };
+int fileWorkers = 1; //Threads that work on one file's buffer together outside batch mode
+
+//Wall-clock time and page faults at the start of a phase of processing, reported with -t
+struct phaseTimer { struct timespec start; long minorFaults, majorFaults; };
+bool reportTiming = false;
+//Page faults taken by the parallelFor workers a thread has started, which its own counts miss
+_Thread_local long workerMinorFaults = 0, workerMajorFaults = 0;
+
+//Batch mode: the input files are shared out among worker threads that each own a buffer pool
+struct batch { char** inputfilenames; int numInputs, nextInput, numWorkersStarted; int argc; 
+               char** argv; pthread_mutex_t lock; };
+pthread_mutex_t printLock = PTHREAD_MUTEX_INITIALIZER; //Keeps one file's printout together
+
+//Mix mode: the inputs are mapped and summed, each with its own gain, into one output file.
+//Workers claim blocks of frames and write each mixed block at its offset in the output file
+#define MIXBLOCKFRAMES 65536
+struct mixInput { char* filename; float gain; };
+struct mix { struct wav* inputs; const float* gains; int numInputs; size_t numFrames; 
+             const struct sampleKernels* kernels; int numChannels; int outputfilehandle; 
+             char* outputfilename; size_t dataOffset, nextBlock; float peak; 
+             pthread_mutex_t lock; };
+
+//Channel modes: -splitch writes each channel of the output to its own mono file and -mergech
+//interleaves several files into one. Workers claim blocks of frames, shuffle them a tile at a
+//time so the interleaved frames stay in cache while every channel is copied, and write each
+//block at its offset in every file
+#define CHANNELBLOCKBYTES (4 * 1024 * 1024) //Interleaved bytes a worker claims at a time
+#define CHANNELTILEBYTES 16384 //Interleaved bytes every channel is copied from at a time
+bool splitChannels = false;
+//Groups are the channels of the input when splitting and the inputs when merging
+struct channelJob { const unsigned char** sources; const size_t* sourceFrames; const int* widths; 
+                    int numGroups, frameSize; int* outputfilehandles; char** outputfilenames; 
+                    const size_t* dataOffsets; size_t numFrames, blockFrames, nextBlock; 
+                    unsigned char silence; bool split, reversed; pthread_mutex_t lock; };
+
+//Compare mode: the sample data of two files is compared frame by frame, as bytes where the
+//formats match and as float samples otherwise. Exact comparisons stop at the first difference
+//and only measure the blocks examined up to it; with -tol, differences up to the tolerance are
+//allowed and the whole files are measured
+#define COMPAREBLOCKFRAMES 65536
+bool exactCompare = true;
+float compareTolerance = 0; //Largest difference allowed between samples, in full scale units
+struct compare { const struct wav* pFirst; const struct wav* pSecond; 
+                 const struct sampleKernels* firstKernels; 
+                 const struct sampleKernels* secondKernels; 
+                 bool sameFormat; size_t numFrames, nextBlock, examinedFrames, firstDifference; 
+                 int differenceChannel; float maxError; double sumSquares; pthread_mutex_t lock; };
+
+//Align mode: the lag between two recordings is found by cross-correlating their envelopes, 
+//decimated to one RMS level per window, with one large FFT, then refined at the full rate by
+//searching the lags around it over an excerpt where the recordings overlap
+#define ALIGNWINDOWMS 2
+#define ALIGNCHUNKWINDOWS 256 //Windows a worker decodes at a time
+#define ALIGNREFINESECONDS 30 //Longest excerpt searched at the full rate
+#define ALIGNREFINEWINDOWS 2 //Windows either side of the envelopes' lag searched at the full rate
+struct envelopeJob { const struct wav* pSoundFile; const struct sampleKernels* kernels; 
+                     size_t windowFrames, numWindows; float* envelope; };
+struct spectraJob { float* re[2]; float* im[2]; size_t n; const float* twiddleRe; 
+                    const float* twiddleIm; const uint32_t* bitReverse; };
+struct refineJob { const float* reference; const float* other; size_t length; int numLags; 
+                   double otherEnergy; double* scores; };
+
+//Sample analysis: one pass of byte-wise OR and XOR reductions over the sound data finds the bits
+//no sample uses and whether every channel holds the same samples, so -repack can drop them
+#define ANALYSISLANES 64 //Bytes reduced side by side; the period is a multiple of this and a frame
+struct analysis { const unsigned char* data; size_t length, period; int sampleBytes; 
+                  unsigned char* ors; unsigned char* xors; }; //One period of each per worker
+
+//EDL mode: a program is rendered from a list of edits against one source in a single pass. The
+//source is mapped so only the ranges the edits use are read, and workers claim blocks of the
+//program and write each at its offset in the output file
+#define EDLBLOCKFRAMES 65536
+#define EDLLINELENGTH 1024 //Longest line of an edit decision list
+struct edit { size_t start, end, programFrame, fadeIn, fadeOut; float gain; };
+struct edlRender { const struct wav* pSource; const struct edit* edits; int numEdits; 
+                   const struct sampleKernels* kernels; size_t numFrames; int outputfilehandle; 
+                   char* outputfilename; size_t dataOffset, nextBlock; pthread_mutex_t lock; };
+
+//Header validation: every file's chunk sizes are checked against its length from its headers
+//alone, and -repair rewrites the sizes of truncated files in place. Workers claim files
+#define MAXHEADERPROBLEMS 256 //Longest description of what is wrong with a file
+struct validation { char** filenames; int numFiles, nextFile, numValid, numRepaired; bool repair; 
+                    pthread_mutex_t lock; };
+
+//Typed sample access. Each supported sample format gets its own fully specialized kernels,
+//stamped out per channel count, so the inner loops work on whole typed frames instead of
+//walking the data subchunk byte by byte
+#define WAVEFORMATPCM 1
+#define WAVEFORMATIEEEFLOAT 3
+#define WAVEFORMATEXTENSIBLE -2 //0xFFFE read through a signed short
+typedef struct { unsigned char bytes[3]; } pcm24;
+struct sampleKernels {
+   const char* name;
+   int bytesPerSample, numChannels; //numChannels is 0 for the any-channel-count kernels
+   //Swaps frame i with frame numFrames - 1 - i for each i in [firstPair, lastPair), so the
+   //mirrored pairs of one reversal can be split among threads
+   void (*reverse)(unsigned char* data, size_t numFrames, size_t firstPair, size_t lastPair,
+                   int numChannels);
+   //Out-of-place reversal: writes frame numFrames - 1 - i of src to frame i of dst for each i in
+   //[firstFrame, lastFrame)
+   void (*reverseCopy)(unsigned char* dst, const unsigned char* src, size_t numFrames, 
+                       size_t firstFrame, size_t lastFrame, int numChannels);
+   void (*toFloat)(const unsigned char* src, float* dst, size_t numSamples);
+   void (*fromFloat)(const float* src, unsigned char* dst, size_t numSamples);
+};
+
+static inline float loadU8(const unsigned char* p) { return ((int)*p - 128) * (1.0f / 128); }
+static inline float loadS16(const unsigned char* p) {
+   int16_t v; memcpy(&v, p, sizeof(v)); return v * (1.0f / 32768);
+}
+static inline float loadS24(const unsigned char* p) {
+   int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+   return (v >> 8) * (1.0f / 8388608);
+}
+static inline float loadS32(const unsigned char* p) {
+   int32_t v; memcpy(&v, p, sizeof(v)); return v * (1.0f / 2147483648.0f);
+}
+static inline float loadF32(const unsigned char* p) { float v; memcpy(&v, p, sizeof(v)); return v; }
+static inline float loadF64(const unsigned char* p) {
+   double v; memcpy(&v, p, sizeof(v)); return (float)v;
+}
+//Stores clamp to the format's range and round to the nearest integer code,
+//without branches that clipped or noisy audio would keep mispredicting
+static inline float clampUnit(float v) { v = v > -1.0f ? v : -1.0f; return v < 1.0f ? v : 1.0f; }
+static inline int32_t roundToInt(float v) { return (int32_t)(v + copysignf(0.5f, v)); }
+static inline void storeU8(unsigned char* p, float v) {
+   int32_t s = roundToInt(clampUnit(v) * 128) + 128; *p = (unsigned char)(s > 255 ? 255 : s);
+}
+static inline void storeS16(unsigned char* p, float v) {
+   int32_t s = roundToInt(clampUnit(v) * 32768); int16_t t = (int16_t)(s > 32767 ? 32767 : s);
+   memcpy(p, &t, sizeof(t));
+}
+static inline void storeS24(unsigned char* p, float v) {
+   int32_t s = roundToInt(clampUnit(v) * 8388608); s = s > 8388607 ? 8388607 : s;
+   p[0] = (unsigned char)s; p[1] = (unsigned char)(s >> 8); p[2] = (unsigned char)(s >> 16);
+}
+static inline void storeS32(unsigned char* p, float v) {
+   double d = (double)clampUnit(v) * 2147483648.0;
+   int32_t t = d >= 2147483647.0 ? 2147483647 : (int32_t)(d < 0 ? d - 0.5 : d + 0.5);
+   memcpy(p, &t, sizeof(t));
+}
+static inline void storeF32(unsigned char* p, float v) { memcpy(p, &v, sizeof(v)); }
+static inline void storeF64(unsigned char* p, float v) { double d = v; memcpy(p, &d, sizeof(d)); }
+
+//CPU feature levels the kernels are compiled for. Every kernel is built once per level and the
+//level is picked at startup from the features the CPU reports, so one binary runs everywhere
+enum isaLevel { ISAGENERIC, ISASSE2, ISAAVX2, ISAAVX512, NUMISALEVELS };
+const char* ISANAMES[NUMISALEVELS] = {"generic", "sse2", "avx2", "avx512"};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DWAVX86
+#define TARGET_generic
+#define TARGET_sse2 __attribute__((target("sse2")))
+#define TARGET_avx2 __attribute__((target("avx2,fma")))
+#define TARGET_avx512 __attribute__((target("avx512f,avx512bw,avx512vl,avx512dq")))
+#else
+#define TARGET_generic
+#define TARGET_sse2
+#define TARGET_avx2
+#define TARGET_avx512
+#endif
+
+//Stamps out the conversion kernels for one sample format
+#define DEFINE_CONVERSION_KERNELS(ISA, FORMAT, TYPE, LOAD, STORE) \
+TARGET_##ISA static void toFloat_##FORMAT##_##ISA(const unsigned char* src, float* dst, \
+                                                 size_t numSamples) { \
+   for(size_t i = 0; i < numSamples; ++i) \
+      dst[i] = LOAD(src + i * sizeof(TYPE)); \
+} \
+TARGET_##ISA static void fromFloat_##FORMAT##_##ISA(const float* src, unsigned char* dst, \
+                                                   size_t numSamples) { \
+   for(size_t i = 0; i < numSamples; ++i) \
+      STORE(dst + i * sizeof(TYPE), src[i]); \
+}
+//Stamps out the frame kernels for one sample format and channel count (0 = any channel count).
+//Frames are swapped as whole typed frames; with CHANNELS fixed the inner loop fully unrolls
+#define DEFINE_FRAME_KERNELS(ISA, FORMAT, TYPE, CHANNELS) \
+TARGET_##ISA static void reverse_##FORMAT##_##CHANNELS##_##ISA(unsigned char* data, \
+   size_t numFrames, size_t firstPair, size_t lastPair, int numChannels) { \
+   const size_t channels = CHANNELS ? CHANNELS : (size_t)numChannels; \
+   TYPE* samples = (TYPE*)data; \
+   for(size_t i = firstPair, j = numFrames - 1 - firstPair; i < lastPair; ++i, --j) { \
+      for(size_t c = 0; c < channels; ++c) { \
+         TYPE temp = samples[i * channels + c]; \
+         samples[i * channels + c] = samples[j * channels + c]; \
+         samples[j * channels + c] = temp; \
+      } \
+   } \
+} \
+TARGET_##ISA static void reverseCopy_##FORMAT##_##CHANNELS##_##ISA(unsigned char* dst, \
+   const unsigned char* src, size_t numFrames, size_t firstFrame, size_t lastFrame, \
+   int numChannels) { \
+   const size_t channels = CHANNELS ? CHANNELS : (size_t)numChannels; \
+   TYPE* out = (TYPE*)dst; \
+   const TYPE* in = (const TYPE*)src; \
+   for(size_t i = firstFrame, j = numFrames - 1 - firstFrame; i < lastFrame; ++i, --j) { \
+      for(size_t c = 0; c < channels; ++c) \
+         out[i * channels + c] = in[j * channels + c]; \
+   } \
+}
+#define DEFINE_SAMPLE_KERNELS(ISA, FORMAT, TYPE, LOAD, STORE) \
+   DEFINE_CONVERSION_KERNELS(ISA, FORMAT, TYPE, LOAD, STORE) \
+   DEFINE_FRAME_KERNELS(ISA, FORMAT, TYPE, 1) \
+   DEFINE_FRAME_KERNELS(ISA, FORMAT, TYPE, 2) \
+   DEFINE_FRAME_KERNELS(ISA, FORMAT, TYPE, 0)
+
+//Format-independent kernels, on float samples unless noted
+struct biquad { float b0, b1, b2, a1, a2; }; //Coefficients of one section, normalized by a0
+struct floatKernels {
+   void (*mix)(float* dst, const float* src, float gain, size_t numSamples);
+   void (*stats)(const float* src, size_t numSamples, float* pPeak, double* pSumSquares);
+   //Filters interleaved frames in place through one biquad section, in transposed direct form
+   //II with each channel in its own lane. The state holds the section's two delays per channel.
+   //Indexed by channel count for mono and stereo, and 0 for any channel count
+   void (*biquad[3])(float* samples, size_t numFrames, int numChannels, 
+                     const struct biquad* pSection, float* state);
+   //In-place forward FFT of n complex values in split form, n a power of two of at least 4. The
+   //inverse is the forward transform with re and im swapped, scaled by 1/n
+   void (*fft)(float* re, float* im, size_t n, const float* twiddleRe, const float* twiddleIm, 
+               const uint32_t* bitReverse);
+   //Accumulates the complex products of two spectra in split form
+   void (*multiplyAdd)(float* accRe, float* accIm, const float* aRe, const float* aIm, 
+                       const float* bRe, const float* bIm, size_t n);
+   //Sums the products of two runs of samples, one lag of a cross-correlation
+   float (*dot)(const float* a, const float* b, size_t numSamples);
+   //Finds the peak magnitude of each frame of interleaved samples
+   void (*peaks)(const float* samples, size_t numFrames, int numChannels, float* peaks);
+   //Computes the gain a level calls for: 1 up to the threshold and a slope in dB per dB over it,
+   //-1 for a limiter
+   void (*dynamicsGain)(const float* levels, float* gains, size_t n, float threshold, 
+                        float slope);
+   //Multiplies each frame of interleaved samples by its gain
+   void (*applyGains)(float* samples, const float* gains, size_t numFrames, int numChannels);
+   //Finds the largest magnitude and sums the squares of the differences between two runs of
+   //samples, adding to the running values
+   void (*difference)(const float* a, const float* b, size_t numSamples, float* pMaxError, 
+                      double* pSumSquares);
+   //ORs every byte of a run of sound data, and its XOR with the byte a shift later, into the
+   //accumulators at its position modulo the period
+   void (*byteReductions)(const unsigned char* data, size_t length, size_t period, size_t shift, 
+                          unsigned char* ors, unsigned char* xors);
+   //Whether every byte of a run of data is zero
+   bool (*allZero)(const unsigned char* data, size_t length);
+};
+#define STATLANES 16 //Independent accumulators so reductions vectorize without reassociation
+//Base-2 logarithm and exponential for gain curves, branchless so they vectorize. The logarithm
+//splits off the exponent, leaving a mantissa in [sqrt(1/2), sqrt(2)), and sums the atanh series;
+//the exponential takes arguments at most 0 and evaluates the Taylor series of the fraction
+static inline float fastLog2(float x) {
+   uint32_t bits;
+   memcpy(&bits, &x, sizeof(bits));
+   int32_t exponent = (int32_t)((bits + 0x004afb0du) >> 23) - 127;
+   bits -= (uint32_t)exponent << 23;
+   float mantissa;
+   memcpy(&mantissa, &bits, sizeof(mantissa));
+   float t = (mantissa - 1) / (mantissa + 1), t2 = t * t;
+   return exponent + t * (2.8853900818f + t2 * (0.9617966939f + t2 * (0.5770780164f + 
+                                                                     t2 * 0.4121985831f)));
+}
+static inline float fastExp2(float y) {
+   y = y < -126 ? -126 : y;
+   int whole = (int)(y - 0.5f);
+   float f = y - whole;
+   float power = 1 + f * (0.6931471806f + f * (0.2402265070f + f * (0.0555041087f + 
+                 f * (0.0096181291f + f * (0.0013333558f + f * 0.0001540353f)))));
+   uint32_t bits = (uint32_t)(whole + 127) << 23;
+   float scale;
+   memcpy(&scale, &bits, sizeof(scale));
+   return power * scale;
+}
+#define DEFINE_FLOAT_KERNELS(ISA) \
+TARGET_##ISA static void mix_##ISA(float* dst, const float* src, float gain, size_t numSamples) { \
+   for(size_t i = 0; i < numSamples; ++i) \
+      dst[i] += gain * src[i]; \
+} \
+TARGET_##ISA static void stats_##ISA(const float* src, size_t numSamples, float* pPeak, \
+                                    double* pSumSquares) { \
+   float peak[STATLANES] = {0}, sumSquares[STATLANES] = {0}; \
+   size_t i = 0; \
+   for(; i + STATLANES <= numSamples; i += STATLANES) { \
+      for(int l = 0; l < STATLANES; ++l) { \
+         float magnitude = src[i + l] < 0 ? -src[i + l] : src[i + l]; \
+         peak[l] = magnitude > peak[l] ? magnitude : peak[l]; \
+         sumSquares[l] += src[i + l] * src[i + l]; \
+      } \
+   } \
+   for(int l = 0; i < numSamples; ++i, ++l) { \
+      float magnitude = src[i] < 0 ? -src[i] : src[i]; \
+      peak[l] = magnitude > peak[l] ? magnitude : peak[l]; \
+      sumSquares[l] += src[i] * src[i]; \
+   } \
+   for(int l = 0; l < STATLANES; ++l) { \
+      *pPeak = peak[l] > *pPeak ? peak[l] : *pPeak; \
+      *pSumSquares += sumSquares[l]; \
+   } \
+} \
+TARGET_##ISA static float dot_##ISA(const float* restrict a, const float* restrict b, \
+                                   size_t numSamples) { \
+   float sum[STATLANES] = {0}; \
+   size_t i = 0; \
+   for(; i + STATLANES <= numSamples; i += STATLANES) { \
+      for(int l = 0; l < STATLANES; ++l) \
+         sum[l] += a[i + l] * b[i + l]; \
+   } \
+   for(int l = 0; i < numSamples; ++i, ++l) \
+      sum[l] += a[i] * b[i]; \
+   float total = 0; \
+   for(int l = 0; l < STATLANES; ++l) \
+      total += sum[l]; \
+   return total; \
+} \
+TARGET_##ISA static void peaks_##ISA(const float* restrict samples, size_t numFrames, \
+                                    int numChannels, float* restrict peaks) { \
+   for(size_t i = 0; i < numFrames; ++i) { \
+      float peak = 0; \
+      for(int c = 0; c < numChannels; ++c) { \
+         float magnitude = fabsf(samples[i * numChannels + c]); \
+         peak = magnitude > peak ? magnitude : peak; \
+      } \
+      peaks[i] = peak; \
+   } \
+} \
+TARGET_##ISA static void dynamicsGain_##ISA(const float* restrict levels, float* restrict gains, \
+                                           size_t n, float threshold, float slope) { \
+   if(slope == -1) { \
+      for(size_t i = 0; i < n; ++i) \
+         gains[i] = threshold / (levels[i] > threshold ? levels[i] : threshold); \
+      return; \
+   } \
+   for(size_t i = 0; i < n; ++i) { \
+      float level = levels[i] > threshold ? levels[i] : threshold; \
+      gains[i] = fastExp2(slope * fastLog2(level / threshold)); \
+   } \
+} \
+TARGET_##ISA static void applyGains_##ISA(float* restrict samples, const float* restrict gains, \
+                                         size_t numFrames, int numChannels) { \
+   for(size_t i = 0; i < numFrames; ++i) { \
+      for(int c = 0; c < numChannels; ++c) \
+         samples[i * numChannels + c] *= gains[i]; \
+   } \
+} \
+TARGET_##ISA static void difference_##ISA(const float* restrict a, const float* restrict b, \
+                                         size_t numSamples, float* pMaxError, \
+                                         double* pSumSquares) { \
+   float maxError[STATLANES] = {0}, sumSquares[STATLANES] = {0}; \
+   size_t i = 0; \
+   for(; i + STATLANES <= numSamples; i += STATLANES) { \
+      for(int l = 0; l < STATLANES; ++l) { \
+         float error = fabsf(a[i + l] - b[i + l]); \
+         maxError[l] = error > maxError[l] ? error : maxError[l]; \
+         sumSquares[l] += error * error; \
+      } \
+   } \
+   for(int l = 0; i < numSamples; ++i, ++l) { \
+      float error = fabsf(a[i] - b[i]); \
+      maxError[l] = error > maxError[l] ? error : maxError[l]; \
+      sumSquares[l] += error * error; \
+   } \
+   for(int l = 0; l < STATLANES; ++l) { \
+      *pMaxError = maxError[l] > *pMaxError ? maxError[l] : *pMaxError; \
+      *pSumSquares += sumSquares[l]; \
+   } \
+} \
+TARGET_##ISA static void byteReductions_##ISA(const unsigned char* restrict data, size_t length, \
+                                             size_t period, size_t shift, \
+                                             unsigned char* restrict ors, \
+                                             unsigned char* restrict xors) { \
+   size_t i = 0; \
+   for(; i + period + shift <= length; i += period) { \
+      for(size_t j = 0; j < period; ++j) { \
+         ors[j] |= data[i + j]; \
+         xors[j] |= data[i + j] ^ data[i + j + shift]; \
+      } \
+   } \
+   for(size_t j = 0; i < length; ++i, j = j + 1 < period ? j + 1 : 0) { \
+      ors[j] |= data[i]; \
+      xors[j] |= i + shift < length ? data[i] ^ data[i + shift] : 0; \
+   } \
+} \
+TARGET_##ISA static bool allZero_##ISA(const unsigned char* restrict data, size_t length) { \
+   unsigned char lanes[ANALYSISLANES] = {0}; \
+   size_t i = 0; \
+   for(; i + ANALYSISLANES <= length; i += ANALYSISLANES) { \
+      for(int l = 0; l < ANALYSISLANES; ++l) { \
+         lanes[l] |= data[i + l]; \
+      } \
+   } \
+   for(int l = 0; i < length; ++i, ++l) { \
+      lanes[l] |= data[i]; \
+   } \
+   unsigned char any = 0; \
+   for(int l = 0; l < ANALYSISLANES; ++l) { \
+      any |= lanes[l]; \
+   } \
+   return any == 0; \
+}
+
+//Stamps out the biquad kernel for one channel count (0 = any channel count). The delays of a
+//group of channels stay in registers across the whole block, and only two multiply-adds per
+//frame depend on the previous frame
+#define BIQUADLANES 16 //Channels filtered together; a whole AVX-512 register of floats
+#define DEFINE_BIQUAD_KERNEL(ISA, CHANNELS) \
+TARGET_##ISA static void biquad_##CHANNELS##_##ISA(float* restrict samples, size_t numFrames, \
+   int numChannels, const struct biquad* pSection, float* restrict state) { \
+   const size_t channels = CHANNELS ? CHANNELS : (size_t)numChannels; \
+   const struct biquad q = *pSection; \
+   for(size_t first = 0; first < channels; first += BIQUADLANES) { \
+      const size_t lanes = channels - first < BIQUADLANES ? channels - first : BIQUADLANES; \
+      float z1[BIQUADLANES], z2[BIQUADLANES]; \
+      for(size_t c = 0; c < lanes; ++c) { \
+         z1[c] = state[first + c]; \
+         z2[c] = state[channels + first + c]; \
+      } \
+      for(size_t i = 0; i < numFrames; ++i) { \
+         float* frame = samples + i * channels + first; \
+         for(size_t c = 0; c < (CHANNELS ? CHANNELS : lanes); ++c) { \
+            float x = frame[c], y = q.b0 * x + z1[c]; \
+            z1[c] = (q.b1 * x + z2[c]) - q.a1 * y; \
+            z2[c] = q.b2 * x - q.a2 * y; \
+            frame[c] = y; \
+         } \
+      } \
+      for(size_t c = 0; c < lanes; ++c) { \
+         state[first + c] = z1[c]; \
+         state[channels + first + c] = z2[c]; \
+      } \
+   } \
+}
+
+//Stamps out the FFT kernels. Each stage of butterflies has its own run of twiddles, stored from
+//offset half - 1, so the innermost loop walks every array contiguously and vectorizes
+#define DEFINE_FFT_KERNELS(ISA) \
+TARGET_##ISA static void fft_##ISA(float* restrict re, float* restrict im, size_t n, \
+   const float* restrict twiddleRe, const float* restrict twiddleIm, \
+   const uint32_t* restrict bitReverse) { \
+   for(size_t i = 0; i < n; ++i) { \
+      size_t j = bitReverse[i]; \
+      if(i < j) { \
+         float temp = re[i]; re[i] = re[j]; re[j] = temp; \
+         temp = im[i]; im[i] = im[j]; im[j] = temp; \
+      } \
+   } \
+   /*The first two stages only multiply by 1 and -i, so they are done together without any*/ \
+   /*multiplies; this needs n to be at least 4*/ \
+   for(size_t start = 0; start < n; start += 4) { \
+      float* r = re + start; \
+      float* m = im + start; \
+      float r0 = r[0] + r[1], r1 = r[0] - r[1], r2 = r[2] + r[3], r3 = r[2] - r[3]; \
+      float m0 = m[0] + m[1], m1 = m[0] - m[1], m2 = m[2] + m[3], m3 = m[2] - m[3]; \
+      r[0] = r0 + r2; m[0] = m0 + m2; \
+      r[2] = r0 - r2; m[2] = m0 - m2; \
+      r[1] = r1 + m3; m[1] = m1 - r3; \
+      r[3] = r1 - m3; m[3] = m1 + r3; \
+   } \
+   for(size_t half = 4; half < n; half *= 2) { \
+      const float* wRe = twiddleRe + half - 1; \
+      const float* wIm = twiddleIm + half - 1; \
+      for(size_t start = 0; start < n; start += 2 * half) { \
+         float* aRe = re + start; \
+         float* aIm = im + start; \
+         float* bRe = aRe + half; \
+         float* bIm = aIm + half; \
+         for(size_t k = 0; k < half; ++k) { \
+            float tRe = bRe[k] * wRe[k] - bIm[k] * wIm[k]; \
+            float tIm = bRe[k] * wIm[k] + bIm[k] * wRe[k]; \
+            bRe[k] = aRe[k] - tRe; \
+            bIm[k] = aIm[k] - tIm; \
+            aRe[k] += tRe; \
+            aIm[k] += tIm; \
+         } \
+      } \
+   } \
+} \
+TARGET_##ISA static void multiplyAdd_##ISA(float* restrict accRe, float* restrict accIm, \
+   const float* restrict aRe, const float* restrict aIm, const float* restrict bRe, \
+   const float* restrict bIm, size_t n) { \
+   for(size_t k = 0; k < n; ++k) { \
+      accRe[k] += aRe[k] * bRe[k] - aIm[k] * bIm[k]; \
+      accIm[k] += aRe[k] * bIm[k] + aIm[k] * bRe[k]; \
+   } \
+}
+
+#define DEFINE_ISA_KERNELS(ISA) \
+   DEFINE_SAMPLE_KERNELS(ISA, u8, uint8_t, loadU8, storeU8) \
+   DEFINE_SAMPLE_KERNELS(ISA, s16, int16_t, loadS16, storeS16) \
+   DEFINE_SAMPLE_KERNELS(ISA, s24, pcm24, loadS24, storeS24) \
+   DEFINE_SAMPLE_KERNELS(ISA, s32, int32_t, loadS32, storeS32) \
+   DEFINE_SAMPLE_KERNELS(ISA, f32, float, loadF32, storeF32) \
+   DEFINE_SAMPLE_KERNELS(ISA, f64, double, loadF64, storeF64) \
+   DEFINE_FLOAT_KERNELS(ISA) \
+   DEFINE_BIQUAD_KERNEL(ISA, 1) \
+   DEFINE_BIQUAD_KERNEL(ISA, 2) \
+   DEFINE_BIQUAD_KERNEL(ISA, 0) \
+   DEFINE_FFT_KERNELS(ISA)
+DEFINE_ISA_KERNELS(generic)
+DEFINE_ISA_KERNELS(sse2)
+DEFINE_ISA_KERNELS(avx2)
+DEFINE_ISA_KERNELS(avx512)
+
+/**
+ * @brief Fallback frame reversal for formats without typed kernels, swapping blockAlign bytes at
+ *        a time.
+ */
+static void reverse_bytes(unsigned char* data, size_t numFrames, size_t firstPair, 
+                          size_t lastPair, int blockAlign) {
+   for(size_t i = firstPair, j = numFrames - 1 - firstPair; i < lastPair; ++i, --j) {
+      for(int b = 0; b < blockAlign; ++b) {
+         unsigned char temp = data[i * blockAlign + b];
+         data[i * blockAlign + b] = data[j * blockAlign + b];
+         data[j * blockAlign + b] = temp;
+      }
+   }
+}
+
+/**
+ * @brief Fallback out-of-place frame reversal for formats without typed kernels, copying
+ *        blockAlign bytes at a time.
+ */
+static void reverseCopy_bytes(unsigned char* dst, const unsigned char* src, size_t numFrames, 
+                              size_t firstFrame, size_t lastFrame, int blockAlign) {
+   for(size_t i = firstFrame, j = numFrames - 1 - firstFrame; i < lastFrame; ++i, --j) {
+      memcpy(dst + i * blockAlign, src + j * blockAlign, blockAlign);
+   }
+}
+
+#define SAMPLEKERNELROW(ISA, FORMAT, TYPE) \
+   { #FORMAT " mono", sizeof(TYPE), 1, reverse_##FORMAT##_1_##ISA, \
+     reverseCopy_##FORMAT##_1_##ISA, toFloat_##FORMAT##_##ISA, fromFloat_##FORMAT##_##ISA }, \
+   { #FORMAT " stereo", sizeof(TYPE), 2, reverse_##FORMAT##_2_##ISA, \
+     reverseCopy_##FORMAT##_2_##ISA, toFloat_##FORMAT##_##ISA, fromFloat_##FORMAT##_##ISA }, \
+   { #FORMAT, sizeof(TYPE), 0, reverse_##FORMAT##_0_##ISA, reverseCopy_##FORMAT##_0_##ISA, \
+     toFloat_##FORMAT##_##ISA, fromFloat_##FORMAT##_##ISA }
+#define SAMPLEKERNELTABLE(ISA) { \
+   SAMPLEKERNELROW(ISA, u8, uint8_t), SAMPLEKERNELROW(ISA, s16, int16_t), \
+   SAMPLEKERNELROW(ISA, s24, pcm24), SAMPLEKERNELROW(ISA, s32, int32_t), \
+   SAMPLEKERNELROW(ISA, f32, float), SAMPLEKERNELROW(ISA, f64, double), \
+   { "generic", 0, 0, reverse_bytes, reverseCopy_bytes, NULL, NULL } }
+enum { KERNELSU8, KERNELSS16 = 3, KERNELSS24 = 6, KERNELSS32 = 9, KERNELSF32 = 12, 
+       KERNELSF64 = 15, KERNELSBYTES = 18, NUMKERNELROWS };
+const struct sampleKernels SAMPLEKERNELS[NUMISALEVELS][NUMKERNELROWS] = {
+   SAMPLEKERNELTABLE(generic), SAMPLEKERNELTABLE(sse2), SAMPLEKERNELTABLE(avx2), 
+   SAMPLEKERNELTABLE(avx512)
+};
+#define FLOATKERNELROW(ISA) \
+   { mix_##ISA, stats_##ISA, { biquad_0_##ISA, biquad_1_##ISA, biquad_2_##ISA }, fft_##ISA, \
+     multiplyAdd_##ISA, dot_##ISA, peaks_##ISA, dynamicsGain_##ISA, applyGains_##ISA, \
+     difference_##ISA, byteReductions_##ISA, allZero_##ISA }
+const struct floatKernels FLOATKERNELS[NUMISALEVELS] = {
+   FLOATKERNELROW(generic), FLOATKERNELROW(sse2), FLOATKERNELROW(avx2), FLOATKERNELROW(avx512)
+};
+enum isaLevel kernelLevel = ISAGENERIC; //The level every kernel lookup dispatches to
+
+//Streaming transforms. Stage flags are recorded in a chain and evaluated lazily: the chain is
+//applied in one pass over blocks of float frames, each stage keeping its own state from block to
+//block, only when the output is written or an operation that moves frames needs the result. The
+//frames then stream from the input straight into the output, and the data in memory is untouched
+#define STAGEBLOCKFRAMES 1024 //Frames per block unless a stage needs larger blocks
+#define STAGEWRITEBYTES (1024 * 1024) //Bytes gathered from blocks before each write to a file
+#define MAXSTAGES 32
+struct stage { void (*process)(struct stage* pStage, float* samples, size_t numFrames, 
+                               int numChannels);
+               size_t blockFrames; //The block size the stage works in, or 0 for any
+               size_t latency; //Frames the stage's output lags behind its input
+               struct biquad section; float* state; struct convolver* convolver; 
+               struct dynamics* dynamics; float gain; };
+struct stageChain { struct stage stages[MAXSTAGES]; int numStages; };
+//Where a chain's frames go, in playing order: into memory, or into a file at an offset
+struct stageSink { unsigned char* memory; int filehandle; char* filename; size_t offset; };
+
+//Limiting and compression. Levels are detected on the frames as they enter a lookahead buffer
+//and the smoothed gains are applied as they leave it, so gain changes anticipate the peaks. Both
+//follow the least gain called for within the lookahead. The compressor smooths it with attack
+//and release times; the limiter releases it exponentially and averages it over the lookahead,
+//which keeps every frame under the ceiling without any hard steps
+#define MINDYNAMICSDB -60
+#define DYNAMICSLOOKAHEADMS 5
+#define LIMITERRELEASEMS 50
+#define COMPRESSORATTACKMS 10
+#define COMPRESSORRELEASEMS 100
+bool unlinkedDetection = false; //Detect levels per channel instead of across all channels
+struct dynamicsDetector { float envelope; 
+                          float* minGains; size_t* minFrames; size_t minFirst, minCount; 
+                          float* recent; size_t recentNext; double recentSum; };
+struct dynamics { bool limiter; int numDetectors; size_t lookahead, numFrames; 
+                  float threshold, slope, attack, release; 
+                  float* levels; float* gains; float* pending; //pending holds the lookahead
+                  struct dynamicsDetector* detectors; };
+
+//Pitch-preserving time-stretching by waveform similarity overlap-add (WSOLA). Hann-windowed
+//segments of the input are overlap-added one hop apart in the output while their hop in the
+//input is scaled by the speed. Each segment is shifted, within a tolerance of half a hop, to
+//where it best continues the waveform of the segment before it
+#define MINSPEED 0.25
+#define MAXSPEED 4.0
+#define WSOLASEGMENTMS 20 //Segment length; long enough to hold two periods of a low voice
+//A sliding window of the input converted to float frames in playing order
+struct stretchInput { const unsigned char* data; size_t numFrames; int numChannels; 
+                      const struct sampleKernels* kernels; bool storedReversed; 
+                      float* frames; size_t firstFrame, numLoaded, capacity; };
+
+//Uniformly partitioned overlap-save convolution. The impulse response is cut into partitions
+//of partitionFrames taps, each kept as the spectrum of a window of 2 * partitionFrames samples.
+//Every block of input is transformed once, kept in a delay line of past spectra, and multiplied
+//with the partition spectra; one inverse transform per block gives its output. The windows are
+//real, so each is transformed as partitionFrames complex values and only the numBins =
+//partitionFrames + 1 bins up to the Nyquist frequency are kept
+#define CONVMINPARTITION 4096
+#define CONVMAXPARTITION 16384 //Keeps a channel's working set within the L2 cache
+struct convolverChannel { float* window; float* output; float* delayRe; float* delayIm; 
+                          int newest; float* re; float* im; };
+struct convolver { size_t partitionFrames, numBins; int numPartitions, numFilters, numChannels; 
+                   float* twiddleRe; float* twiddleIm; uint32_t* bitReverse; 
+                   float* realTwiddleRe; float* realTwiddleIm; //e^(-i pi k / partitionFrames)
+                   float* filterRe; float* filterIm; //numFilters * numPartitions spectra
+                   struct convolverChannel* channels; 
+                   float* samples; size_t numFrames; }; //The block the workers are given
+
+int getFlag(char* flag);
 bool isValidFlag(char* flag);
+void processFile(char* inputfilename, char* outputfilename, int argc, char* argv[], 
+                 struct bufferPool* pool);
+void* batchWorker(void* pBatch);
+void runBatch(char* inputfilenames[], int numInputs, int numWorkers, int argc, char* argv[]);
+int collectBatchInputs(size_t index, int argc, char* argv[]);
+int collectMixInputs(size_t index, int argc, char* argv[], struct mixInput** pInputs, 
+                     int* pNumInputs);
+void runMix(struct mixInput inputs[], int numInputs, char* outputfilename);
+void mixSlice(void* pMix, int worker, int numWorkers);
+int validateJobCount(size_t index, int argc, char* argv[]);
+void* poolAcquire(struct bufferPool* pool, size_t size);
+void poolRelease(struct bufferPool* pool, void* memory);
+void poolDestroy(struct bufferPool* pool);
+void detectNumaTopology(void);
+int workerNode(int worker);
+void bindToNode(int node);
+void placeOnNode(void* memory, size_t length, int node);
+void* parallelWorker(void* pTask);
+void parallelFor(int numWorkers, void (*body)(void* context, int worker, int numWorkers), 
+                 void* context);
+void getMirroredSlice(size_t length, int worker, int numWorkers, size_t* pFirst, size_t* pLast);
+void countFaults(long* pMinorFaults, long* pMajorFaults);
+void startPhase(struct phaseTimer* pTimer);
+void endPhase(struct phaseTimer* pTimer, const char* phaseName);
 void setFilename(char** pFilename, size_t index, int argc, char* argv[]);
 bool isValidFilename(char* filename);
 void validateSampleRate(size_t index, int argc, char* argv[]);
-char* getMemory(char* filename);
+char* getMemory(char* filename, struct bufferPool* pool, size_t* pLength);
+void readSlices(void* pRead, int worker, int numWorkers);
+char* mapInputFile(char* filename, size_t* pLength);
 size_t getLength(int filehandle);
 bool isDataSubChunk(char* subChunk);
-void printFile(struct wav* pSoundFile, int extraParamsSize, int numExtraSubChunks,
-               struct data extraChunks[]);
+void parseWavFile(char* filename, unsigned char* wavBytes, size_t length, struct wav* pSoundFile);
+struct data* findSubChunk(struct wav* pSoundFile, const char* subChunkID, const char* listType);
+FILE* statusStream(void);
+void reportBegin(struct report* pReport, const char* title, const char* key, char bracket);
+void reportEnd(struct report* pReport, char bracket);
+void reportText(struct report* pReport, const char* label, const char* key, 
+                const unsigned char* text, size_t maxLength);
+void reportInt(struct report* pReport, const char* label, const char* key, long long value);
+void reportDecimal(struct report* pReport, const char* label, const char* key, double value);
+void printBext(struct report* pReport, struct data* pBext, int sampleRate);
+void printInfo(struct report* pReport, struct data* pList);
+void printIXML(struct report* pReport, struct data* pIXML);
+void printFile(struct wav* pSoundFile);
+void addTagEdit(size_t index, int argc, char* argv[]);
+void validateJunkSize(size_t index, int argc, char* argv[]);
+int validateSectorSize(size_t index, int argc, char* argv[]);
+bool isPaddingSubChunk(const struct data* subChunk);
+void applyTagEdits(struct wav* pSoundFile);
+void printMarkers(struct report* pReport, struct wav* pSoundFile);
+void validateTrimRange(size_t index, int argc, char* argv[]);
+void trimFile(struct wav* pSoundFile, size_t startFrame, size_t endFrame, bool storedReversed);
+bool mapFrameRange(const struct frameMap* pMap, size_t* pStart, size_t* pEnd);
+void remapMarkers(struct wav* pSoundFile);
+void writeTagsInPlace(char* filename, struct wav* pSoundFile);
 void changeSampleRate(struct wav* pSoundFile, int newSampleRate);
+bool isaSupported(enum isaLevel level);
+enum isaLevel detectIsaLevel(void);
+void setIsaLevel(size_t index, int argc, char* argv[]);
+short getFormatTag(const struct wav* pSoundFile);
+const struct sampleKernels* getSampleKernels(const struct wav* pSoundFile);
+void reverseSlice(void* pSoundFile, int worker, int numWorkers);
 void reverseFile(struct wav* pSoundFile);
-void writeOutputFile(char* outputfilename, struct wav* pSoundFile, struct extraParams parameters, 
-                     int extraParamsSize, int numExtraSubChunks, struct data extraChunks[]);
-void changeSpeed(struct wav* pSoundFile, int speedMultiple);
-void shiftChannel(struct wav* pSoundFile, int channelLength, int seekArm, int speedMultiple);
-bool elimSample(int index, int speedMultiple, int bytesPerSample);
+int layoutOutputFile(struct wav* pSoundFile, struct outputPiece pieces[], size_t* pLength);
+void writeOutputFile(char* outputfilename, struct wav* pSoundFile, struct stageChain* pChain);
+size_t writePieces(int outputfilehandle, char* outputfilename, const struct outputPiece pieces[], 
+                   int numPieces, int inputfilehandle, const unsigned char* fileBytes);
+int createOutputFile(char* outputfilename, struct wav* pSoundFile, size_t* pDataOffset, 
+                     size_t* pLength);
+int openOutputFile(char* outputfilename);
+void closeOutputFile(int outputfilehandle, char* outputfilename);
+void commitOutputFiles(void);
+void commitOutputFilesAtExit(void);
+bool commitOutputGroup(struct outputGroup* pGroup);
+void syncOutputsSlice(void* pGroup, int worker, int numWorkers);
+bool publishOutputFile(int outputfilehandle, char* outputfilename);
+char* getTempFilename(char* outputfilename);
+char* getDirectory(char* filename);
+void writeAt(int outputfilehandle, char* outputfilename, const unsigned char* bytes, size_t length, 
+             size_t offset);
+size_t findZeroPages(const unsigned char* bytes, size_t length, size_t fileOffset, size_t* pStart);
+void punchZeroPages(int outputfilehandle, const unsigned char* bytes, size_t length, 
+                    size_t fileOffset);
+int compareFrames(const void* pFirst, const void* pSecond);
+void writeSegments(char* inputfilename, char* outputfilename, struct wav* pSoundFile, 
+                   bool reversed);
+void writeSegmentsSlice(void* pSplit, int worker, int numWorkers);
+bool isStageFlag(int flag);
+void validateFilter(size_t index, int argc, char* argv[], int numValues);
+void designBiquad(int flag, double frequency, double gain, int sampleRate, 
+                  struct biquad* pSection);
+void processBiquad(struct stage* pStage, float* samples, size_t numFrames, int numChannels);
+void validateGain(size_t index, int argc, char* argv[]);
+void processGain(struct stage* pStage, float* samples, size_t numFrames, int numChannels);
+size_t addStages(struct wav* pSoundFile, size_t index, int argc, char* argv[], 
+                 struct stageChain* pChain);
+void flushStages(struct wav* pSoundFile, struct stageChain* pChain, bool storedReversed);
+void destroyStages(struct stageChain* pChain);
+void streamStages(struct wav* pSoundFile, struct stage stages[], int numStages, 
+                  bool storedReversed, const struct stageSink* pSink);
+struct convolver* createConvolver(char* irfilename, const struct fmt* pFormat);
+void destroyConvolver(struct convolver* pConvolver);
+void processConvolver(struct stage* pStage, float* samples, size_t numFrames, int numChannels);
+void convolveChannels(void* pConvolver, int worker, int numWorkers);
+void validateDynamics(size_t index, int argc, char* argv[], int numValues);
+struct dynamics* createDynamics(bool limiter, double levelDb, double ratio, 
+                                const struct wav* pSoundFile);
+void destroyDynamics(struct dynamics* pDynamics);
+void processDynamics(struct stage* pStage, float* samples, size_t numFrames, int numChannels);
+void forwardRealFft(const struct convolver* pConvolver, const float* samples, float* re, 
+                    float* im);
+void inverseRealFft(const struct convolver* pConvolver, float* re, float* im, float* samples);
+void copyFramesSlice(void* pCopy, int worker, int numWorkers);
+void writeMappedOutputFile(char* outputfilename, struct wav* pSoundFile, bool reversed, 
+                           struct stageChain* pChain);
+void validateSpeed(size_t index, int argc, char* argv[]);
+void changeSpeed(struct wav* pSoundFile, double speed, bool storedReversed);
+float* fetchFrames(struct stretchInput* pInput, size_t firstFrame, size_t lastFrame);
+void writeChannels(char* outputfilename, struct wav* pSoundFile, bool reversed);
+void runMerge(char* inputfilenames[], int numInputs, char* outputfilename);
+void shuffleChannelsSlice(void* pJob, int worker, int numWorkers);
+void copySamples(unsigned char* dst, long dstStride, const unsigned char* src, long srcStride, 
+                 size_t numSamples, int width);
+void validateTolerance(size_t index, int argc, char* argv[]);
+bool runCompare(char* firstfilename, char* secondfilename);
+void compareSlice(void* pCompare, int worker, int numWorkers);
+void buildFftTables(size_t n, float* twiddleRe, float* twiddleIm, uint32_t* bitReverse);
+void runAlign(char* referencefilename, char* otherfilename, char* outputfilename);
+float* computeEnvelope(const struct wav* pSoundFile, size_t windowFrames, size_t* pNumWindows);
+void envelopeSlice(void* pJob, int worker, int numWorkers);
+void transformSlice(void* pJob, int worker, int numWorkers);
+float* readMono(const struct wav* pSoundFile, long long firstFrame, size_t numFrames);
+void refineSlice(void* pJob, int worker, int numWorkers);
+void writeAligned(char* outputfilename, struct wav* pSoundFile, long long offset, 
+                  size_t numFrames);
+bool isIntegerFormat(const struct wav* pSoundFile);
+void analyzeSamples(const struct wav* pSoundFile, bool* pIdenticalChannels, int* pUsedBits);
+void analysisSlice(void* pAnalysis, int worker, int numWorkers);
+void printAnalysis(struct wav* pSoundFile);
+void repackFile(struct wav* pSoundFile);
+void validateEdlFilename(size_t index, int argc, char* argv[]);
+struct edit* parseEdl(char* edlfilename, size_t sourceFrames, int* pNumEdits);
+void runEdl(char* sourcefilename, char* edlfilename, char* outputfilename);
+void edlSlice(void* pRender, int worker, int numWorkers);
+bool runValidate(char* filenames[], int numFiles, bool repair);
+void validateSlice(void* pValidation, int worker, int numWorkers);
+bool isChunkID(const char* id);
+bool checkHeader(char* filename, bool repair, char* problems, size_t problemsSize, 
+                 bool* pRepaired);
 
 /**
  * @brief Analyzes the flags the user denotes. Opens a .wav file, prints out its data, alters the
  *        data as per the user's specifications, and, if necessary, writes the data to an output
- *        file.
+ *        file. In batch mode, does the same for every listed file using a pool of worker threads.
+ *        In mix mode, sums the listed files into one output file instead, and in merge mode
+ *        interleaves their channels into one output file. In compare mode, compares the sound
+ *        data of two files and exits with status 1 if they differ, and in align mode finds the
+ *        offset between two recordings of the same sound. In EDL mode, renders a program from a
+ *        list of edits against the input file, and in validate mode checks the headers of the
+ *        listed files, repairing truncated ones with -repair.
  */
 int main(int argc, char* argv[]) {
    char* inputfilename = DEFAULTINPUTFILENAME;
    char* outputfilename = DEFAULTOUTPUTFILENAME;
+   char** batchInputs = NULL;
+   char** mergeInputs = NULL;
+   char** checkInputs = NULL;
+   bool repairHeaders = false;
+   char* compareInputs[2] = { NULL, NULL };
+   char* alignInputs[2] = { NULL, NULL };
+   char* edlfilename = NULL;
+   bool outputRequested = false;
+   struct mixInput* mixInputs = NULL;
+   int numBatchInputs = 0, numMixInputs = 0, numMergeInputs = 0, numCheckInputs = 0;
+   int numWorkers = 1;
+   kernelLevel = detectIsaLevel();
    //Verify arguments are valid and set requested input and output filenames
    for(size_t i = 1; i < argc; ++i) {
       if(isValidFlag(argv[i])) {
-         switch(argv[i][1]) {
-            case 'i':
+         switch(getFlag(argv[i])) {
+            case FLAGINPUT:
                setFilename(&inputfilename, ++i, argc, argv);
                break;
-            case 'o':
+            case FLAGOUTPUT:
                setFilename(&outputfilename, ++i, argc, argv);
+               outputRequested = true;
                break;
-            case 'h':
+            case FLAGSAMPLERATE:
                validateSampleRate(++i, argc, argv);
                break;
+            case FLAGISA:
+               setIsaLevel(++i, argc, argv);
+               break;
+            case FLAGBATCH:
+               batchInputs = &argv[i + 1];
+               numBatchInputs = collectBatchInputs(i + 1, argc, argv);
+               i += numBatchInputs;
+               break;
+            case FLAGJOBS:
+               numWorkers = validateJobCount(++i, argc, argv);
+               break;
+            case FLAGHUGETLB:
+               explicitHugePages = true;
+               break;
+            case FLAGPREFAULT:
+               prefaultBuffers = true;
+               break;
+            case FLAGTIMING:
+               reportTiming = true;
+               break;
+            case FLAGNUMA:
+               numaAware = true;
+               break;
+            case FLAGMAPPED:
+               mappedOutput = true;
+               break;
+            case FLAGJSON:
+               jsonReport = true;
+               break;
+            case FLAGIXML:
+               fullIXML = true;
+               break;
+            case FLAGTAG:
+               addTagEdit(++i, argc, argv);
+               ++i;
+               break;
+            case FLAGEDIT:
+               editInPlace = true;
+               break;
+            case FLAGJUNK:
+               validateJunkSize(++i, argc, argv);
+               junkReservation = atoi(argv[i]);
+               break;
+            case FLAGSECTOR:
+               sectorAlignment = validateSectorSize(++i, argc, argv);
+               break;
+            case FLAGDIRECT:
+               directInput = true;
+               break;
+            case FLAGSPARSE:
+               sparseOutput = true;
+               break;
+            case FLAGATOMIC:
+               atomicOutput = true;
+               break;
+            case FLAGSYNC:
+               //Outputs already finished are still named if a later one fails
+               if(!syncOutput) {
+                  atexit(commitOutputFilesAtExit);
+               }
+               atomicOutput = true;
+               syncOutput = true;
+               break;
+            case FLAGTRIM:
+               validateTrimRange(++i, argc, argv);
+               ++i;
+               break;
+            case FLAGSPLITCUES:
+               splitAtCues = true;
+               break;
+            case FLAGHIGHPASS:
+            case FLAGLOWPASS:
+               validateFilter(++i, argc, argv, 1);
+               break;
+            case FLAGLOWSHELF:
+            case FLAGHIGHSHELF:
+               validateFilter(++i, argc, argv, 2);
+               ++i;
+               break;
+            case FLAGCONVOLVE: {
+               char* irfilename;
+               setFilename(&irfilename, ++i, argc, argv);
+               break;
+            }
+            case FLAGSPEED:
+               validateSpeed(++i, argc, argv);
+               break;
+            case FLAGGAIN:
+               validateGain(++i, argc, argv);
+               break;
+            case FLAGLIMIT:
+               validateDynamics(++i, argc, argv, 1);
+               break;
+            case FLAGCOMPRESS:
+               validateDynamics(++i, argc, argv, 2);
+               ++i;
+               break;
+            case FLAGUNLINKED:
+               unlinkedDetection = true;
+               break;
+            case FLAGMIX:
+               free(mixInputs);
+               i += collectMixInputs(i + 1, argc, argv, &mixInputs, &numMixInputs);
+               break;
+            case FLAGSPLITCHANNELS:
+               splitChannels = true;
+               break;
+            case FLAGMERGECHANNELS:
+               mergeInputs = &argv[i + 1];
+               numMergeInputs = collectBatchInputs(i + 1, argc, argv);
+               i += numMergeInputs;
+               break;
+            case FLAGCOMPARE:
+               setFilename(&compareInputs[0], ++i, argc, argv);
+               setFilename(&compareInputs[1], ++i, argc, argv);
+               break;
+            case FLAGTOLERANCE:
+               validateTolerance(++i, argc, argv);
+               exactCompare = false;
+               compareTolerance = (float)pow(10, strtod(argv[i], NULL) / 20);
+               break;
+            case FLAGALIGN:
+               setFilename(&alignInputs[0], ++i, argc, argv);
+               setFilename(&alignInputs[1], ++i, argc, argv);
+               break;
+            case FLAGEDL:
+               validateEdlFilename(++i, argc, argv);
+               edlfilename = argv[i];
+               break;
+            case FLAGVALIDATE:
+            case FLAGREPAIR:
+               repairHeaders = getFlag(argv[i]) == FLAGREPAIR;
+               checkInputs = &argv[i + 1];
+               numCheckInputs = collectBatchInputs(i + 1, argc, argv);
+               i += numCheckInputs;
+               break;
          }
       }
       else {
@@ -77,325 +1135,5576 @@ int main(int argc, char* argv[]) {
          exit(1);
       }
    }
+   if(editInPlace && numTagEdits == 0) {
+      printf("No tags to edit. Please see README for usage.");
+      exit(1);
+   }
+   if((numBatchInputs > 0) + (numMixInputs > 0) + (numMergeInputs > 0) + 
+      (compareInputs[0] != NULL) + (alignInputs[0] != NULL) + (edlfilename != NULL) + 
+      (numCheckInputs > 0) > 1) {
+      printf("-b, -mix, -mergech, -cmp, -align, -edl and -validate or -repair cannot be combined. "
+             "Please see README for usage.");
+      exit(1);
+   }
+   if(!exactCompare && !compareInputs[0]) {
+      printf("-tol only applies to -cmp. Please see README for usage.");
+      exit(1);
+   }
+   if(splitChannels && splitAtCues) {
+      printf("-splitch cannot be combined with -splitcues. Please see README for usage.");
+      exit(1);
+   }
+   if(numaAware) {
+      detectNumaTopology();
+   }
+   if(alignInputs[0]) {
+      fileWorkers = numWorkers;
+      runAlign(alignInputs[0], alignInputs[1], outputRequested ? outputfilename : NULL);
+   }
+   else if(numCheckInputs > 0) {
+      fileWorkers = numWorkers;
+      if(!runValidate(checkInputs, numCheckInputs, repairHeaders)) {
+         exit(1);
+      }
+   }
+   else if(edlfilename) {
+      fileWorkers = numWorkers;
+      runEdl(inputfilename, edlfilename, outputfilename);
+   }
+   else if(compareInputs[0]) {
+      fileWorkers = numWorkers;
+      if(!runCompare(compareInputs[0], compareInputs[1])) {
+         exit(1);
+      }
+   }
+   else if(numMixInputs > 0) {
+      fileWorkers = numWorkers;
+      runMix(mixInputs, numMixInputs, outputfilename);
+      free(mixInputs);
+   }
+   else if(numMergeInputs > 0) {
+      fileWorkers = numWorkers;
+      runMerge(mergeInputs, numMergeInputs, outputfilename);
+   }
+   else if(numBatchInputs > 0) {
+      runBatch(batchInputs, numBatchInputs, numWorkers, argc, argv);
+   }
+   else {
+      struct bufferPool pool = { .numBuffers = 0 };
+      fileWorkers = numWorkers;
+      processFile(inputfilename, outputfilename, argc, argv, &pool);
+      poolDestroy(&pool);
+   }
+   commitOutputFiles();
+}
+
+/**
+ * @brief Opens a .wav file, prints out its data, alters the data as per the flags in argv, and,
+ *        if necessary, writes the data to an output file.
+ * 
+ * @param inputfilename the name of the .wav file to be processed
+ * @param outputfilename the name of the file the altered data is written to
+ * @param pool the buffer pool the file's memory is taken from and returned to
+ */
+void processFile(char* inputfilename, char* outputfilename, int argc, char* argv[], 
+                 struct bufferPool* pool) {
    //Read file and break down into organized structs
-   char* wavMem = getMemory(inputfilename);
-   unsigned char* wavBytes = (unsigned char*)wavMem;
-   int seekArm = sizeof(struct riff) + sizeof(struct fmt);
-   int extraParamsSize = (((struct fmt*)&wavBytes[sizeof(struct riff)]))->subChunk1Size - 
-                         FMTSUBCHUNKSIZENOPARAMS;
-   struct extraParams parameters;
-   if(extraParamsSize > 0) {
-      parameters = (*(struct extraParams*)&wavBytes[seekArm]);
-      seekArm += extraParamsSize;
-   }
-
-   //Separate overflow caused by extra subchunks from the data subchunk
-   //Store this overflow and reintegrate the data subchunk into the wav struct
-   int numExtraSubChunks = 0;
-   struct data extraChunks[MAXEXTRASUBCHUNKS];
-   while(!isDataSubChunk((char*)&wavBytes[seekArm])) {
-      extraChunks[numExtraSubChunks] = (*(struct data*)&wavBytes[seekArm]);
-      //increment the seek arm by just the size of the data subchunk's ID and Size
-      seekArm += extraChunks[numExtraSubChunks].subChunk2Size + sizeof(char[4]) + sizeof(int);
-      ++numExtraSubChunks;
-   }
-   struct data fileData = *(struct data*)&wavBytes[seekArm];
-   struct wav* pSoundFile = (struct wav*)wavBytes;
-   pSoundFile->dataElements = fileData;
-
-   printFile(pSoundFile, extraParamsSize, numExtraSubChunks, extraChunks);
+   struct phaseTimer timer;
+   size_t length = 0;
+   startPhase(&timer);
+   //Editing in place and splitting map the file so only the pages they need are ever read
+   bool mapInput = mappedOutput || editInPlace || splitAtCues || splitChannels;
+   char* wavMem = mapInput ? mapInputFile(inputfilename, &length) : 
+                             getMemory(inputfilename, pool, &length);
+   endPhase(&timer, "Read");
+   struct wav soundFile;
+   struct wav* pSoundFile = &soundFile;
+   parseWavFile(inputfilename, (unsigned char*)wavMem, length, pSoundFile);
+
+   pthread_mutex_lock(&printLock);
+   printFile(pSoundFile);
+   pthread_mutex_unlock(&printLock);
+   if(numTagEdits > 0) {
+      applyTagEdits(pSoundFile);
+   }
+   if(editInPlace) {
+      writeTagsInPlace(inputfilename, pSoundFile);
+#ifndef _WIN32
+      munmap(wavMem, length);
+#endif
+      free(pSoundFile->editedInfo);
+      free(pSoundFile->remappedMarkers);
+      return;
+   }
 
    //Execute the remainder of flags and write the result into a new file if necessary
    bool copy = false;
+   bool reversePending = false; //Mapped and split modes defer reversal into the output copy
+   bool deferReversal = mappedOutput || splitAtCues || splitChannels;
+   struct stageChain chain = { .numStages = 0 }; //Stages wait here until their result is needed
+   startPhase(&timer);
    for(size_t i = 1; i < argc; ++i) {
-      switch(argv[i][1]) {
-         case 'o':
+      switch(getFlag(argv[i])) {
+         case FLAGOUTPUT:
+            copy = true;
+         case FLAGINPUT:
+         case FLAGISA:
+         case FLAGJOBS:
+            ++i;
+            break;
+         case FLAGTAG:
+            i += 2;
             copy = true;
-         case 'i':
+            break;
+         case FLAGJUNK:
+         case FLAGSECTOR:
             ++i;
+            copy = true;
             break;
-         case 'c':
+         case FLAGBATCH:
             copy = true;
+            i += collectBatchInputs(i + 1, argc, argv);
             break;
-         case 'h':
+         case FLAGCOPY:
+         case FLAGSPLITCUES:
+         case FLAGSPLITCHANNELS:
+            copy = true;
+            break;
+         case FLAGSAMPLERATE:
             changeSampleRate(pSoundFile, atoi(argv[++i]));
             copy = true;
             break;
-         case 'r':
-            reverseFile(pSoundFile);
+         case FLAGREVERSE:
+            flushStages(pSoundFile, &chain, reversePending);
+            if(deferReversal) {
+               reversePending = !reversePending;
+            }
+            else {
+               reverseFile(pSoundFile);
+            }
+            pSoundFile->frames.reversed = !pSoundFile->frames.reversed;
+            copy = true;
+            break;
+         case FLAGTRIM:
+            flushStages(pSoundFile, &chain, reversePending);
+            trimFile(pSoundFile, strtoull(argv[i + 1], NULL, 10), strtoull(argv[i + 2], NULL, 10), 
+                     reversePending);
+            i += 2;
+            copy = true;
+            break;
+         case FLAGHIGHPASS:
+         case FLAGLOWPASS:
+         case FLAGLOWSHELF:
+         case FLAGHIGHSHELF:
+         case FLAGCONVOLVE:
+         case FLAGLIMIT:
+         case FLAGCOMPRESS:
+         case FLAGGAIN:
+            i = addStages(pSoundFile, i, argc, argv, &chain);
+            copy = true;
+            break;
+         case FLAGSPEED:
+            flushStages(pSoundFile, &chain, reversePending);
+            changeSpeed(pSoundFile, strtod(argv[++i], NULL), reversePending);
+            copy = true;
+            break;
+         case FLAGANALYZE:
+            flushStages(pSoundFile, &chain, reversePending);
+            printAnalysis(pSoundFile);
+            break;
+         case FLAGREPACK:
+            flushStages(pSoundFile, &chain, reversePending);
+            repackFile(pSoundFile);
             copy = true;
             break;
       }
    }
+   endPhase(&timer, "Transform");
    if(copy) {
-      writeOutputFile(outputfilename, pSoundFile, parameters, extraParamsSize, numExtraSubChunks, 
-                      extraChunks);
+      startPhase(&timer);
+      if(splitAtCues || splitChannels) {
+         flushStages(pSoundFile, &chain, reversePending);
+      }
+      if(splitAtCues) {
+         writeSegments(inputfilename, outputfilename, pSoundFile, reversePending);
+      }
+      else if(splitChannels) {
+         writeChannels(outputfilename, pSoundFile, reversePending);
+      }
+      else if(mappedOutput) {
+         writeMappedOutputFile(outputfilename, pSoundFile, reversePending, &chain);
+      }
+      else {
+         writeOutputFile(outputfilename, pSoundFile, &chain);
+      }
+      endPhase(&timer, "Write");
+   }
+   destroyStages(&chain);
+   if(mapInput) {
+#ifndef _WIN32
+      munmap(wavMem, length);
+#endif
+   }
+   else {
+      poolRelease(pool, wavMem);
    }
-   free(wavMem);
+   free(pSoundFile->editedInfo);
+   free(pSoundFile->remappedMarkers);
+   free(pSoundFile->rebuiltData);
+   free(pSoundFile->repackedParams);
 }
 
 /**
- * @brief Returns whether or not a flag is valid, that is, if it is contained within the existing
- *        array of valid flags
+ * @brief Worker thread body for batch mode. Claims input files one at a time and processes each
+ *        into "<input name>_out.wav", reusing the worker's own buffer pool across files.
  * 
- * @param flag the flag to be tested
- * @return true if the existing flag is contained in the array VALIDFLAGS.
- *         false otherwise.
+ * @param pBatch a pointer to the shared batch struct
+ * @return void* always NULL
  */
-bool isValidFlag(char* flag) {
-   //increments through the valid flags and tests for equality to the submitted flag
-   for(size_t i = 0; i < NUMVALIDFLAGS; ++i) {
-      if(strcmp(flag, VALIDFLAGS[i]) == 0) {
-         return true;
+void* batchWorker(void* pBatch) {
+   struct batch* pJobs = (struct batch*)pBatch;
+   struct bufferPool pool = { .numBuffers = 0 };
+   //Workers are spread round-robin over the NUMA nodes. A bound worker first-touches its own
+   //pool, so every job it claims runs on one node against that node's memory
+   pthread_mutex_lock(&pJobs->lock);
+   int worker = pJobs->numWorkersStarted++;
+   pthread_mutex_unlock(&pJobs->lock);
+   bindToNode(workerNode(worker));
+   while(true) {
+      pthread_mutex_lock(&pJobs->lock);
+      int input = pJobs->nextInput++;
+      pthread_mutex_unlock(&pJobs->lock);
+      if(input >= pJobs->numInputs) {
+         break;
+      }
+      char* inputfilename = pJobs->inputfilenames[input];
+      size_t stemLength = strlen(inputfilename) - strlen(VALIDEXTENSION);
+      char* outputfilename = (char*)malloc(stemLength + sizeof(BATCHOUTPUTSUFFIX));
+      if(!outputfilename) {
+         printf("Error in allocating memory.");
+         exit(1);
       }
+      memcpy(outputfilename, inputfilename, stemLength);
+      strcpy(outputfilename + stemLength, BATCHOUTPUTSUFFIX);
+      processFile(inputfilename, outputfilename, pJobs->argc, pJobs->argv, &pool);
+      free(outputfilename);
    }
-   return false;
+   poolDestroy(&pool);
+   return NULL;
 }
 
 /**
- * @brief Verifies whether the filename the user requested from the command line via the -i or -o 
- *        flag is valid: that is, whether it ends in ".wav". Saves the desired filename.
+ * @brief Processes every input file of a batch, sharing them out among worker threads.
  * 
- * @param pFilename the pointer which holds the final filename
- * @param index the index in argv at which the desired filename resides
- * @pre pFilename holds one of the default filenames
- * @post pFilename holds the desired filename, assuming that filename was valid
+ * @param inputfilenames the names of the .wav files to be processed
+ * @param numInputs the number of files to be processed
+ * @param numWorkers the number of worker threads to process them with
  */
-void setFilename(char** pFilename, size_t index, int argc, char* argv[]) {
-   if(index >= argc) {
-      printf("No filename specified. Please see README for usage.");
+void runBatch(char* inputfilenames[], int numInputs, int numWorkers, int argc, char* argv[]) {
+   struct batch jobs = { inputfilenames, numInputs, 0, 0, argc, argv, PTHREAD_MUTEX_INITIALIZER };
+   pthread_t* workers = (pthread_t*)malloc(numWorkers * sizeof(pthread_t));
+   if(!workers) {
+      printf("Error in allocating memory.");
       exit(1);
    }
-   if(!isValidFilename(argv[index])) {
-      printf("Invalid filename %s. Filenames must end with '.wav'.", argv[index]);
-      exit(1);
+   if(numWorkers > numInputs) {
+      numWorkers = numInputs;
    }
-   *pFilename = argv[index];
+   for(int i = 0; i < numWorkers; ++i) {
+      if(pthread_create(&workers[i], NULL, batchWorker, &jobs) != 0) {
+         printf("Error starting worker thread.");
+         exit(1);
+      }
+   }
+   for(int i = 0; i < numWorkers; ++i) {
+      pthread_join(workers[i], NULL);
+   }
+   free(workers);
 }
 
 /**
- * @brief Checks to see if a filename is valid.
+ * @brief Validates the filenames following a -b flag, which run up to the next flag or the end of
+ *        the arguments.
  * 
- * @param filename the filename whose validity is to be checked.
- * @return true if the filename parameter ends in ".wav".
- *         false otherwise.
+ * @param index the index in argv at which the first filename resides
+ * @return int the number of filenames in the batch
  */
-bool isValidFilename(char* filename) {
-  return (strstr(filename, VALIDEXTENSION) + strlen(VALIDEXTENSION) == filename + strlen(filename));
+int collectBatchInputs(size_t index, int argc, char* argv[]) {
+   int numInputs = 0;
+   while(index + numInputs < argc && !isValidFlag(argv[index + numInputs])) {
+      if(!isValidFilename(argv[index + numInputs])) {
+         printf("Invalid filename %s. Filenames must end with '.wav'.", argv[index + numInputs]);
+         exit(1);
+      }
+      ++numInputs;
+   }
+   if(numInputs == 0) {
+      printf("No filenames specified. Please see README for usage.");
+      exit(1);
+   }
+   return numInputs;
 }
 
 /**
- * @brief Checks to make sure there is a valid (positive and nonzero) sample rate in the
- *        command-line argument following a -hz flag.
+ * @brief Checks to make sure there is a valid (positive and nonzero) worker count in the
+ *        command-line argument following a -j flag.
  * 
- * @param index the index at which the desired sample rate resides
+ * @param index the index at which the desired worker count resides
+ * @return int the worker count
  */
-void validateSampleRate(size_t index, int argc, char* argv[]) {
+int validateJobCount(size_t index, int argc, char* argv[]) {
    if(index >= argc) {
-      printf("No sample rate specified. Please see README for usage.");
+      printf("No worker count specified. Please see README for usage.");
       exit(1);
    }
-
-   //Tests if the requested sample rate is a positive nonzero integer
-   if(atoi(argv[index]) <= 0) {
-      printf("Invalid sample rate %s. Sample rates must be positive nonzero integers.", 
+   int numWorkers = atoi(argv[index]);
+   if(numWorkers <= 0) {
+      printf("Invalid worker count %s. Worker counts must be positive nonzero integers.", 
              argv[index]);
       exit(1);
    }
+   return numWorkers;
 }
 
 /**
- * @brief Opens the specified file, allocates enough memory to holds its data, reats the file's
- *        data into that memory, and closes the file.
+ * @brief Hands out a page-aligned buffer of at least the requested size, reusing the smallest
+ *        idle buffer in the pool that is large enough before mapping a new one.
  * 
- * @param filename the name of the .wav file to be analyzed
- * @return char* a pointer to the memory holding the file data.
+ * @param pool the pool to take the buffer from
+ * @param size the number of bytes needed
+ * @return void* a pointer to the buffer
  */
-char* getMemory(char* filename) {
-   //Opens the file
-   int filehandle = open(filename, O_RDONLY | O_BINARY);
-   if(filehandle == -1) {
-      printf("File %s does not exist", filename);
-      exit(1);
+void* poolAcquire(struct bufferPool* pool, size_t size) {
+   struct poolBuffer* best = NULL;
+   struct poolBuffer* largestIdle = NULL;
+   for(int i = 0; i < pool->numBuffers; ++i) {
+      struct poolBuffer* buffer = &pool->buffers[i];
+      if(buffer->inUse) {
+         continue;
+      }
+      if(buffer->capacity >= size && (!best || buffer->capacity < best->capacity)) {
+         best = buffer;
+      }
+      if(!largestIdle || buffer->capacity > largestIdle->capacity) {
+         largestIdle = buffer;
+      }
    }
-   printf("Opening file %s\n", filename);
-
-   //Allocates memory for the file
-   size_t length = getLength(filehandle);
-   char* wavMem = (char*)malloc(length);
-   if(!wavMem) {
+   if(best) {
+      best->inUse = true;
+      return best->memory;
+   }
+   //No idle buffer is large enough: grow into a free slot, or replace the largest idle buffer
+   if(pool->numBuffers < MAXPOOLBUFFERS) {
+      best = &pool->buffers[pool->numBuffers++];
+   }
+   else if(largestIdle) {
+      best = largestIdle;
+#ifdef _WIN32
+      _aligned_free(best->memory);
+#else
+      munmap(best->memory, best->capacity);
+#endif
+   }
+   else {
       printf("Error in allocating memory.");
       exit(1);
    }
-
-   //Reads the file into the memory
-   int bytesRead = read(filehandle, wavMem, length);
-   if(bytesRead != length) {
-      printf("Could not read entire file.");
+   size_t granularity = size >= POOLHUGEPAGESIZE ? POOLHUGEPAGESIZE : POOLPAGESIZE;
+   best->capacity = (size + granularity - 1) / granularity * granularity;
+#ifdef _WIN32
+   best->memory = _aligned_malloc(best->capacity, POOLPAGESIZE);
+#else
+   best->memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+   //Explicit huge pages come from the hugetlbfs reserve, which may be empty; fall back to THP
+   if(explicitHugePages && granularity == POOLHUGEPAGESIZE) {
+      int hugeFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_POPULATE
+      hugeFlags |= prefaultBuffers ? MAP_POPULATE : 0;
+#endif
+      best->memory = mmap(NULL, best->capacity, PROT_READ | PROT_WRITE, hugeFlags, -1, 0);
+   }
+#endif
+   if(best->memory == MAP_FAILED) {
+      best->memory = mmap(NULL, best->capacity, PROT_READ | PROT_WRITE, 
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if(best->memory != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+         if(granularity == POOLHUGEPAGESIZE) {
+            madvise(best->memory, best->capacity, MADV_HUGEPAGE);
+         }
+#endif
+         //Prefault only after the huge page advice, so the pages come in as huge pages
+         if(prefaultBuffers) {
+            for(size_t offset = 0; offset < best->capacity; offset += POOLPAGESIZE) {
+               ((volatile char*)best->memory)[offset] = 0;
+            }
+         }
+      }
+   }
+   if(best->memory == MAP_FAILED) {
+      best->memory = NULL;
+   }
+#endif
+   if(!best->memory) {
+      printf("Error in allocating memory.");
       exit(1);
    }
-   printf("Bytes Read: %d\n", bytesRead);
-
-   close(filehandle);
-   return wavMem;
+   best->inUse = true;
+   return best->memory;
 }
 
 /**
- * @brief Finds the length of the file and moves the seek arm back to the beginning of the file.
+ * @brief Returns a buffer to its pool so a later job can reuse it.
  * 
- * @param filehandle the handle of the file to be analyzed
- * @return size_t the length of the file in bytes
+ * @param pool the pool the buffer was taken from
+ * @param memory a pointer to the buffer
  */
-size_t getLength(int filehandle) {
-   size_t currentPos = lseek(filehandle, (size_t)0, SEEK_CUR);
-   size_t length = lseek(filehandle, (size_t)0, SEEK_END);
-   lseek(filehandle, currentPos, SEEK_SET);
-   return length;
+void poolRelease(struct bufferPool* pool, void* memory) {
+   for(int i = 0; i < pool->numBuffers; ++i) {
+      if(pool->buffers[i].memory == memory) {
+         pool->buffers[i].inUse = false;
+         return;
+      }
+   }
 }
 
 /**
- * @brief Determines whether the given subchunk is the 'data' subchunk of the sound file.
+ * @brief Unmaps every buffer in a pool.
  * 
- * @param subChunk a pointer to the subchunk to be analyzed
- * @return true if the subchunk's ID is 'data'
-           false otherwise
+ * @param pool the pool to be emptied
  */
-bool isDataSubChunk(char* subChunk) {
-   if(strncmp((((struct data*)subChunk)->subChunk2ID), "data", 4) == 0)
-      return true;
-   return false;
+void poolDestroy(struct bufferPool* pool) {
+   for(int i = 0; i < pool->numBuffers; ++i) {
+#ifdef _WIN32
+      _aligned_free(pool->buffers[i].memory);
+#else
+      munmap(pool->buffers[i].memory, pool->buffers[i].capacity);
+#endif
+   }
+   pool->numBuffers = 0;
 }
 
 /**
- * @brief Prints a formatted summary of the human-readable data in the .wav file
- * 
- * @param pSoundFile a pointer to the .wav file data to be printed
- * @param extraParamsSize the number of extra parameters in the .wav file
- * @param numExtraSubChunks the number of extra subchunks in the .wav file
- * @param extraChunks the extra chunks in the .wav file
+ * @brief Reads the CPU list of every NUMA node from sysfs. Without NUMA support, or on a
+ *        single-node machine, everything stays on one node.
  */
-void printFile(struct wav* pSoundFile, int extraParamsSize, int numExtraSubChunks, 
-               struct data extraChunks[]) { 
-   struct riff fileRiff = pSoundFile->riffElements;
-   struct fmt fileFormat = pSoundFile->formatElements;
-   struct data fileData = pSoundFile->dataElements;
-
-   printf("\nRIFF ELEMENTS\n");
-   printf("ChunkID: %c%c%c%c\n", fileRiff.chunkID[0], fileRiff.chunkID[1], fileRiff.chunkID[2], 
-                                 fileRiff.chunkID[3]);
-   printf("ChunkSize: %d\n", fileRiff.chunkSize);
-   printf("Format: %c%c%c%c\n", fileRiff.format[0], fileRiff.format[1], fileRiff.format[2], 
-                                fileRiff.format[3]);
-
-   printf("\nFORMAT ELEMENTS\n");
-   printf("Subchunk1ID: %c%c%c\n", fileFormat.subChunk1ID[0], fileFormat.subChunk1ID[1], 
-                                   fileFormat.subChunk1ID[2]);
-   printf("Subchunk1 Size: %d\n", fileFormat.subChunk1Size);
-   printf("Audio Form: %d\n", fileFormat.audioForm);
-   printf("Number of Channels: %d\n", fileFormat.numChannels);
-   printf("Sample Rate: %d\n", fileFormat.sampleRate);
-   printf("Byte Rate: %d\n", fileFormat.byteRate);
-   printf("Block Align: %d\n", fileFormat.blockAlign);
-   printf("Bits Per Sample: %d\n", fileFormat.bitsPerSample);
-   if(extraParamsSize > 0) {
-      printf("Extra Parameters: Yes\n");
-   }
-   else {
-      printf("Extra Parameters: No\n");
-   }
-   printf("\nDATA ELEMENTS\n");
-   printf("Subchunk2ID: %c%c%c%c\n", fileData.subChunk2ID[0], fileData.subChunk2ID[1], 
-                                     fileData.subChunk2ID[2], fileData.subChunk2ID[3]);
-   printf("Subchunk2 Size: %d\n", fileData.subChunk2Size);
-   printf("\nExtra Subchunks Found: %d \n\n", numExtraSubChunks);
-   if(numExtraSubChunks > 0) {
-         for(int i = 0; i < numExtraSubChunks; ++i) {
-            printf("Extra Subchunk Names: ");
-            printf("%.4s", extraChunks[i].subChunk2ID);
-            printf(" of Size %d\n", extraChunks[i].subChunk2Size);
-         
-         if((numExtraSubChunks - i) > 1) {
-            printf(", ");
-         }
+void detectNumaTopology(void) {
+#ifdef __linux__
+   int numNodes = 0;
+   for(; numNodes < MAXNUMANODES; ++numNodes) {
+      char path[64];
+      snprintf(path, sizeof(path), NUMANODEPATH, numNodes);
+      FILE* cpulist = fopen(path, "r");
+      if(!cpulist) {
+         break;
       }
-      printf("\n");
-   }
+      //The list is comma-separated ranges such as "0-15,32-47"
+      CPU_ZERO(&numaNodes.cpus[numNodes]);
+      int first, last;
+      while(fscanf(cpulist, "%d", &first) == 1) {
+         last = first;
+         int separator = fgetc(cpulist);
+         if(separator == '-') {
+            if(fscanf(cpulist, "%d", &last) != 1) {
+               break;
+            }
+            separator = fgetc(cpulist);
+         }
+         for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &numaNodes.cpus[numNodes]);
+         }
+         if(separator != ',') {
+            break;
+         }
+      }
+      fclose(cpulist);
+   }
+   numaNodes.numNodes = numNodes > 0 ? numNodes : 1;
+#endif
+   fprintf(statusStream(), "NUMA Nodes: %d\n", numaNodes.numNodes);
+}
+
+/**
+ * @brief Finds the NUMA node a worker is placed on. Workers are spread round-robin over the nodes.
+ * 
+ * @param worker the index of the worker
+ * @return int the node the worker runs on
+ */
+int workerNode(int worker) {
+   return worker % numaNodes.numNodes;
+}
+
+/**
+ * @brief Binds the calling thread to the CPUs of a NUMA node, so the memory it first touches is
+ *        allocated on that node. Does nothing without -numa.
+ * 
+ * @param node the node to be bound to
+ */
+void bindToNode(int node) {
+#ifdef __linux__
+   if(numaAware && numaNodes.numNodes > 1) {
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &numaNodes.cpus[node]);
+   }
+#endif
+}
+
+/**
+ * @brief Asks the kernel to keep the pages of a range of memory on a NUMA node, moving pages that
+ *        were already faulted in elsewhere. Does nothing without -numa.
+ * 
+ * @param memory the start of the range
+ * @param length the length of the range in bytes
+ * @param node the node the range should live on
+ */
+void placeOnNode(void* memory, size_t length, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+   if(!numaAware || numaNodes.numNodes <= 1 || length == 0) {
+      return;
+   }
+   const int preferred = 1, moveExisting = 1 << 1; //MPOL_PREFERRED and MPOL_MF_MOVE
+   //mbind works on whole pages; only pages entirely inside the range are placed
+   uintptr_t first = ((uintptr_t)memory + POOLPAGESIZE - 1) / POOLPAGESIZE * POOLPAGESIZE;
+   uintptr_t last = ((uintptr_t)memory + length) / POOLPAGESIZE * POOLPAGESIZE;
+   unsigned long nodeMask[MAXNUMANODES / (8 * sizeof(unsigned long)) + 1] = {0};
+   nodeMask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+   if(last > first) {
+      syscall(SYS_mbind, (void*)first, last - first, preferred, nodeMask, MAXNUMANODES + 1, 
+              moveExisting);
+   }
+#endif
+}
+
+/**
+ * @brief Thread body for parallelFor. Binds the thread to its worker's node and runs the body.
+ * 
+ * @param pTask a pointer to the worker's parallelTask struct
+ * @return void* always NULL
+ */
+void* parallelWorker(void* pTask) {
+   struct parallelTask* task = (struct parallelTask*)pTask;
+   bindToNode(workerNode(task->worker));
+   long minorFaults = 0, majorFaults = 0;
+   if(reportTiming) {
+      countFaults(&minorFaults, &majorFaults);
+   }
+   task->body(task->context, task->worker, task->numWorkers);
+   if(reportTiming) {
+      countFaults(&task->minorFaults, &task->majorFaults);
+      task->minorFaults -= minorFaults;
+      task->majorFaults -= majorFaults;
+   }
+   return NULL;
+}
+
+/**
+ * @brief Runs a body on numWorkers threads, passing each its worker index, and waits for all of
+ *        them. With a single worker the body runs on the calling thread. The workers' page faults
+ *        are added to the calling thread's, so a phase's counts include them.
+ * 
+ * @param numWorkers the number of workers to share the work among
+ * @param body the function each worker runs
+ * @param context the argument passed through to every worker
+ */
+void parallelFor(int numWorkers, void (*body)(void* context, int worker, int numWorkers), 
+                 void* context) {
+   if(numWorkers <= 1) {
+      body(context, 0, 1);
+      return;
+   }
+   pthread_t* threads = (pthread_t*)malloc(numWorkers * sizeof(pthread_t));
+   struct parallelTask* tasks = (struct parallelTask*)malloc(numWorkers * 
+                                                             sizeof(struct parallelTask));
+   if(!threads || !tasks) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   for(int i = 0; i < numWorkers; ++i) {
+      tasks[i] = (struct parallelTask){ body, context, i, numWorkers, 0, 0 };
+      if(pthread_create(&threads[i], NULL, parallelWorker, &tasks[i]) != 0) {
+         printf("Error starting worker thread.");
+         exit(1);
+      }
+   }
+   for(int i = 0; i < numWorkers; ++i) {
+      pthread_join(threads[i], NULL);
+      workerMinorFaults += tasks[i].minorFaults;
+      workerMajorFaults += tasks[i].majorFaults;
+   }
+   free(tasks);
+   free(threads);
+}
+
+/**
+ * @brief Finds a worker's share of the mirrored pairs of a range, the unit of work of reversal.
+ *        Worker w owns pairs [first, last): the elements at those positions from the front of
+ *        the range and the ones mirroring them from the back, so a worker's reads, writes and
+ *        memory placement stay within its own two slices.
+ * 
+ * @param length the length of the range
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the range
+ * @param pFirst holds the first pair of the worker's share
+ * @param pLast holds one past the last pair of the worker's share
+ */
+void getMirroredSlice(size_t length, int worker, int numWorkers, size_t* pFirst, size_t* pLast) {
+   size_t numPairs = length / 2;
+   *pFirst = numPairs * worker / numWorkers;
+   *pLast = numPairs * (worker + 1) / numWorkers;
+   //The last worker also owns the unpaired middle element, if there is one
+   if(worker == numWorkers - 1) {
+      *pLast = length - numPairs;
+   }
+}
+
+/**
+ * @brief Counts the page faults taken so far by the calling thread and by every worker it has
+ *        started. Where threads have no counts of their own, the whole process's are used.
+ * 
+ * @param pMinorFaults holds the number of minor page faults
+ * @param pMajorFaults holds the number of major page faults
+ */
+void countFaults(long* pMinorFaults, long* pMajorFaults) {
+   *pMinorFaults = *pMajorFaults = 0;
+#ifndef _WIN32
+   struct rusage usage;
+#ifdef RUSAGE_THREAD
+   getrusage(RUSAGE_THREAD, &usage);
+   *pMinorFaults = workerMinorFaults;
+   *pMajorFaults = workerMajorFaults;
+#else
+   getrusage(RUSAGE_SELF, &usage);
+#endif
+   *pMinorFaults += usage.ru_minflt;
+   *pMajorFaults += usage.ru_majflt;
+#endif
+}
+
+/**
+ * @brief Records the wall-clock time and the page fault counts of the calling thread and its
+ *        workers at the start of a phase of processing.
+ * 
+ * @param pTimer the timer to be started
+ */
+void startPhase(struct phaseTimer* pTimer) {
+   if(!reportTiming) {
+      return;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &pTimer->start);
+   countFaults(&pTimer->minorFaults, &pTimer->majorFaults);
+}
+
+/**
+ * @brief Prints the time taken and the page faults taken since a phase of processing started.
+ * 
+ * @param pTimer the timer started at the beginning of the phase
+ * @param phaseName the name the phase is reported under
+ */
+void endPhase(struct phaseTimer* pTimer, const char* phaseName) {
+   if(!reportTiming) {
+      return;
+   }
+   struct phaseTimer end;
+   startPhase(&end);
+   double milliseconds = (end.start.tv_sec - pTimer->start.tv_sec) * 1e3 + 
+                         (end.start.tv_nsec - pTimer->start.tv_nsec) / 1e6;
+   fprintf(statusStream(), "%s Time: %.3f ms (%ld minor, %ld major page faults)\n", phaseName, 
+           milliseconds, end.minorFaults - pTimer->minorFaults, 
+           end.majorFaults - pTimer->majorFaults);
+}
+
+/**
+ * @brief Looks up a flag in the existing array of valid flags
+ * 
+ * @param flag the flag to be looked up
+ * @return int the flag's index in VALIDFLAGS, which is its enum flag value.
+ *         -1 if the flag is not valid.
+ */
+int getFlag(char* flag) {
+   //increments through the valid flags and tests for equality to the submitted flag
+   for(size_t i = 0; i < NUMVALIDFLAGS; ++i) {
+      if(strcmp(flag, VALIDFLAGS[i]) == 0) {
+         return (int)i;
+      }
+   }
+   return -1;
+}
+
+/**
+ * @brief Returns whether or not a flag is valid, that is, if it is contained within the existing
+ *        array of valid flags
+ * 
+ * @param flag the flag to be tested
+ * @return true if the existing flag is contained in the array VALIDFLAGS.
+ *         false otherwise.
+ */
+bool isValidFlag(char* flag) {
+   return getFlag(flag) >= 0;
+}
+
+/**
+ * @brief Verifies whether the filename the user requested from the command line via the -i or -o 
+ *        flag is valid: that is, whether it ends in ".wav". Saves the desired filename.
+ * 
+ * @param pFilename the pointer which holds the final filename
+ * @param index the index in argv at which the desired filename resides
+ * @pre pFilename holds one of the default filenames
+ * @post pFilename holds the desired filename, assuming that filename was valid
+ */
+void setFilename(char** pFilename, size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No filename specified. Please see README for usage.");
+      exit(1);
+   }
+   if(!isValidFilename(argv[index])) {
+      printf("Invalid filename %s. Filenames must end with '.wav'.", argv[index]);
+      exit(1);
+   }
+   *pFilename = argv[index];
+}
+
+/**
+ * @brief Checks to see if a filename is valid.
+ * 
+ * @param filename the filename whose validity is to be checked.
+ * @return true if the filename parameter ends in ".wav".
+ *         false otherwise.
+ */
+bool isValidFilename(char* filename) {
+  return (strstr(filename, VALIDEXTENSION) + strlen(VALIDEXTENSION) == filename + strlen(filename));
+}
+
+/**
+ * @brief Checks to make sure there is a valid (positive and nonzero) sample rate in the
+ *        command-line argument following a -hz flag.
+ * 
+ * @param index the index at which the desired sample rate resides
+ */
+void validateSampleRate(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No sample rate specified. Please see README for usage.");
+      exit(1);
+   }
+
+   //Tests if the requested sample rate is a positive nonzero integer
+   if(atoi(argv[index]) <= 0) {
+      printf("Invalid sample rate %s. Sample rates must be positive nonzero integers.", 
+             argv[index]);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Opens the specified file, takes enough memory from the pool to holds its data, reats the
+ *        file's data into that memory, and closes the file.
+ * 
+ * @param filename the name of the .wav file to be analyzed
+ * @param pool the buffer pool the memory is taken from
+ * @param pLength holds the length of the file data
+ * @return char* a pointer to the memory holding the file data.
+ */
+char* getMemory(char* filename, struct bufferPool* pool, size_t* pLength) {
+   //Opens the file, bypassing the page cache if requested and the file system allows it
+   int filehandle = -1;
+   size_t alignment = 1;
+#ifdef O_DIRECT
+   if(directInput) {
+      filehandle = open(filename, O_RDONLY | O_BINARY | O_DIRECT);
+      alignment = DIRECTIOALIGNMENT;
+   }
+#endif
+   if(filehandle == -1) {
+      filehandle = open(filename, O_RDONLY | O_BINARY);
+      alignment = 1;
+   }
+   if(filehandle == -1) {
+      printf("File %s does not exist", filename);
+      exit(1);
+   }
+   fprintf(statusStream(), "Opening file %s\n", filename);
+
+   //Allocates memory for the file. Direct reads work in whole aligned blocks, so the buffer has
+   //room for the last block in full
+   size_t length = getLength(filehandle);
+   char* wavMem = (char*)poolAcquire(pool, (length + alignment - 1) / alignment * alignment);
+
+   //Reads the file into the memory. With several workers, each reads the mirrored slices it will
+   //later reverse, so the pages are first touched (or placed) on that worker's NUMA node
+   struct fileRead read = { filehandle, wavMem, length, alignment, 0, PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, readSlices, &read);
+   if(read.bytesRead != length) {
+      printf("Could not read entire file.");
+      exit(1);
+   }
+   fprintf(statusStream(), "Bytes Read: %zu\n", read.bytesRead);
+   *pLength = length;
+
+   close(filehandle);
+   return wavMem;
+}
+
+/**
+ * @brief Maps the specified file into memory copy-on-write, so it can be used in place of a copy
+ *        read by getMemory without ever modifying the file.
+ * 
+ * @param filename the name of the .wav file to be analyzed
+ * @param pLength holds the length of the mapping
+ * @return char* a pointer to the mapped file data.
+ */
+char* mapInputFile(char* filename, size_t* pLength) {
+#ifdef _WIN32
+   printf("Mapped mode is not supported on this platform.");
+   exit(1);
+#else
+   int filehandle = open(filename, O_RDONLY | O_BINARY);
+   if(filehandle == -1) {
+      printf("File %s does not exist", filename);
+      exit(1);
+   }
+   fprintf(statusStream(), "Opening file %s\n", filename);
+   *pLength = getLength(filehandle);
+   char* wavMem = (char*)mmap(NULL, *pLength, PROT_READ | PROT_WRITE, MAP_PRIVATE, filehandle, 0);
+   if(wavMem == MAP_FAILED) {
+      printf("Error in mapping file %s.", filename);
+      exit(1);
+   }
+   madvise(wavMem, *pLength, MADV_SEQUENTIAL);
+   fprintf(statusStream(), "Bytes Mapped: %zu\n", *pLength);
+   close(filehandle);
+   return wavMem;
+#endif
+}
+
+/**
+ * @brief Reads one worker's mirrored slices of a file into memory, placing them on the worker's
+ *        NUMA node. Large reads can come back short, so each slice is read until done.
+ * 
+ * @param pRead a pointer to the shared fileRead struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers reading the file
+ */
+void readSlices(void* pRead, int worker, int numWorkers) {
+   struct fileRead* file = (struct fileRead*)pRead;
+   size_t first, last;
+   getMirroredSlice(file->length, worker, numWorkers, &first, &last);
+   size_t ranges[2][2] = { { first, last }, { file->length - last, file->length - first } };
+   if(last > file->length / 2) {
+      ranges[0][1] = file->length - first; //The middle worker's slices meet, read them as one
+      ranges[1][0] = ranges[1][1];
+   }
+   //Direct reads move every boundary to a block boundary, the end of the file up and every other
+   //one down, so the workers' ranges still tile the file exactly
+   for(int r = 0; r < 2 && file->alignment > 1; ++r) {
+      for(int b = 0; b < 2; ++b) {
+         ranges[r][b] = ranges[r][b] == file->length ? 
+            (file->length + file->alignment - 1) / file->alignment * file->alignment : 
+            ranges[r][b] / file->alignment * file->alignment;
+      }
+   }
+   size_t bytesRead = 0;
+   for(int r = 0; r < 2; ++r) {
+      placeOnNode(file->memory + ranges[r][0], ranges[r][1] - ranges[r][0], workerNode(worker));
+      for(size_t offset = ranges[r][0]; offset < ranges[r][1]; ) {
+#ifdef _WIN32
+         lseek(file->filehandle, offset, SEEK_SET); //Only one worker reads on Windows
+         long chunkRead = read(file->filehandle, file->memory + offset, ranges[r][1] - offset);
+#else
+         long chunkRead = pread(file->filehandle, file->memory + offset, ranges[r][1] - offset, 
+                                offset);
+#endif
+         if(chunkRead <= 0) {
+            break; //The end of the file, or an error caught by the caller's length check
+         }
+         offset += chunkRead;
+         bytesRead += chunkRead;
+      }
+   }
+   pthread_mutex_lock(&file->lock);
+   file->bytesRead += bytesRead;
+   pthread_mutex_unlock(&file->lock);
+}
+
+/**
+ * @brief Finds the length of the file and moves the seek arm back to the beginning of the file.
+ * 
+ * @param filehandle the handle of the file to be analyzed
+ * @return size_t the length of the file in bytes
+ */
+size_t getLength(int filehandle) {
+   size_t currentPos = lseek(filehandle, (size_t)0, SEEK_CUR);
+   size_t length = lseek(filehandle, (size_t)0, SEEK_END);
+   lseek(filehandle, currentPos, SEEK_SET);
+   return length;
+}
+
+/**
+ * @brief Determines whether the given subchunk is the 'data' subchunk of the sound file.
+ * 
+ * @param subChunk a pointer to the subchunk to be analyzed
+ * @return true if the subchunk's ID is 'data'
+           false otherwise
+ */
+bool isDataSubChunk(char* subChunk) {
+   if(strncmp((((struct data*)subChunk)->subChunk2ID), "data", 4) == 0)
+      return true;
+   return false;
+}
+
+/**
+ * @brief Walks the subchunks of a .wav file in memory, filling in the wav struct. The contents of
+ *        every subchunk are left in place; the wav struct only points at them.
+ * 
+ * @param filename the name of the .wav file, for error messages
+ * @param wavBytes the memory holding the file data
+ * @param length the length of the file data
+ * @param pSoundFile the wav struct to be filled in
+ */
+void parseWavFile(char* filename, unsigned char* wavBytes, size_t length, struct wav* pSoundFile) {
+   if(length < sizeof(struct riff) || strncmp((char*)wavBytes, "RIFF", 4) != 0 || 
+      strncmp((char*)wavBytes + 8, "WAVE", 4) != 0) {
+      printf("File %s is not a .wav file.", filename);
+      exit(1);
+   }
+   memcpy(&pSoundFile->riffElements, wavBytes, sizeof(struct riff));
+   pSoundFile->fileBytes = wavBytes;
+   pSoundFile->fileLength = length;
+   pSoundFile->editedInfo = NULL;
+   pSoundFile->remappedMarkers = NULL;
+   pSoundFile->rebuiltData = NULL;
+   pSoundFile->repackedParams = NULL;
+   pSoundFile->extraParams = NULL;
+   pSoundFile->extraParamsSize = 0;
+   pSoundFile->numExtraSubChunks = 0;
+   pSoundFile->numSubChunksBeforeData = -1;
+   bool foundFormat = false;
+   size_t seekArm = sizeof(struct riff);
+   while(seekArm + CHUNKHEADERSIZE <= length) {
+      struct data subChunk;
+      memcpy(&subChunk, &wavBytes[seekArm], CHUNKHEADERSIZE);
+      subChunk.subChunkData = &wavBytes[seekArm + CHUNKHEADERSIZE];
+      //A subchunk running past the end of the file is cut short to what is actually there
+      size_t available = length - seekArm - CHUNKHEADERSIZE;
+      if(subChunk.subChunk2Size < 0 || (size_t)subChunk.subChunk2Size > available) {
+         subChunk.subChunk2Size = (int)available;
+      }
+      if(strncmp(subChunk.subChunk2ID, "fmt ", 4) == 0 && 
+         subChunk.subChunk2Size >= FMTSUBCHUNKSIZENOPARAMS) {
+         memcpy(&pSoundFile->formatElements, &wavBytes[seekArm], sizeof(struct fmt));
+         pSoundFile->formatElements.subChunk1Size = subChunk.subChunk2Size;
+         pSoundFile->extraParamsSize = subChunk.subChunk2Size - FMTSUBCHUNKSIZENOPARAMS;
+         pSoundFile->extraParams = subChunk.subChunkData + FMTSUBCHUNKSIZENOPARAMS;
+         foundFormat = true;
+      }
+      else if(isDataSubChunk((char*)&subChunk) && pSoundFile->numSubChunksBeforeData < 0) {
+         pSoundFile->dataElements = subChunk;
+         pSoundFile->numSubChunksBeforeData = pSoundFile->numExtraSubChunks;
+      }
+      else {
+         if(pSoundFile->numExtraSubChunks == MAXEXTRASUBCHUNKS) {
+            printf("File %s has more than %d extra subchunks.", filename, MAXEXTRASUBCHUNKS);
+            exit(1);
+         }
+         pSoundFile->extraChunks[pSoundFile->numExtraSubChunks++] = subChunk;
+      }
+      //Subchunks are padded to an even length
+      seekArm += CHUNKHEADERSIZE + subChunk.subChunk2Size + (subChunk.subChunk2Size & 1);
+   }
+   if(!foundFormat || pSoundFile->numSubChunksBeforeData < 0) {
+      printf("File %s is missing its %s subchunk.", filename, foundFormat ? "data" : "fmt");
+      exit(1);
+   }
+   int blockSize = pSoundFile->formatElements.blockAlign;
+   size_t numFrames = blockSize > 0 ? (size_t)pSoundFile->dataElements.subChunk2Size / blockSize : 0;
+   pSoundFile->frames = (struct frameMap){ 0, numFrames, numFrames, false, 1, false };
+   pSoundFile->samplesAltered = false;
+}
+
+/**
+ * @brief Finds the first extra subchunk with the given ID, and for LIST subchunks the given list
+ *        type.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be searched
+ * @param subChunkID the four-character ID of the subchunk
+ * @param listType the four-character type of a LIST subchunk, or NULL for other subchunks
+ * @return struct data* a pointer to the subchunk, or NULL if there is none
+ */
+struct data* findSubChunk(struct wav* pSoundFile, const char* subChunkID, const char* listType) {
+   for(int i = 0; i < pSoundFile->numExtraSubChunks; ++i) {
+      struct data* subChunk = &pSoundFile->extraChunks[i];
+      if(strncmp(subChunk->subChunk2ID, subChunkID, 4) == 0 && 
+         (!listType || (subChunk->subChunk2Size >= 4 && 
+                        strncmp((char*)subChunk->subChunkData, listType, 4) == 0))) {
+         return subChunk;
+      }
+   }
+   return NULL;
+}
+
+/**
+ * @brief Picks where progress lines such as files opened, bytes moved and phase times go: with
+ *        the reports on stdout, or on stderr with -json so stdout holds nothing but JSON.
+ * 
+ * @return FILE* the stream progress lines are printed to
+ */
+FILE* statusStream(void) {
+   return jsonReport ? stderr : stdout;
+}
+
+/**
+ * @brief Starts a section of a report: a titled block of text, or a JSON object or array.
+ * 
+ * @param pReport the report being printed
+ * @param title the title printed above the section in text reports, or NULL for none
+ * @param key the section's key in its enclosing JSON object, or NULL inside arrays
+ * @param bracket '{' for an object or '[' for an array
+ */
+void reportBegin(struct report* pReport, const char* title, const char* key, char bracket) {
+   if(pReport->json) {
+      printf(pReport->needsComma ? "," : "");
+      if(key) {
+         printf("\"%s\":", key);
+      }
+      printf("%c", bracket);
+      pReport->needsComma = false;
+   }
+   else if(title) {
+      printf("\n%s\n", title);
+   }
+}
+
+/**
+ * @brief Ends a section of a report.
+ * 
+ * @param pReport the report being printed
+ * @param bracket '}' for an object or ']' for an array
+ */
+void reportEnd(struct report* pReport, char bracket) {
+   if(pReport->json) {
+      printf("%c", bracket);
+      pReport->needsComma = true;
+   }
+}
+
+/**
+ * @brief Reports a text field straight from the file's memory. The text ends at the first null
+ *        character or after maxLength characters, whichever comes first.
+ * 
+ * @param pReport the report being printed
+ * @param label the field's label in text reports
+ * @param key the field's key in JSON reports
+ * @param text the text to be reported
+ * @param maxLength the most characters the text can have
+ */
+void reportText(struct report* pReport, const char* label, const char* key, 
+                const unsigned char* text, size_t maxLength) {
+   size_t length = 0;
+   while(length < maxLength && text[length] != '\0') {
+      ++length;
+   }
+   if(!pReport->json) {
+      printf("%s: %.*s\n", label, (int)length, (const char*)text);
+      return;
+   }
+   printf("%s\"%s\":\"", pReport->needsComma ? "," : "", key);
+   for(size_t i = 0; i < length; ++i) {
+      if(text[i] == '"' || text[i] == '\\') {
+         printf("\\%c", text[i]);
+      }
+      else if(text[i] < 0x20) {
+         printf("\\u%04x", text[i]);
+      }
+      else {
+         putchar(text[i]);
+      }
+   }
+   printf("\"");
+   pReport->needsComma = true;
+}
+
+/**
+ * @brief Reports an integer field.
+ * 
+ * @param pReport the report being printed
+ * @param label the field's label in text reports
+ * @param key the field's key in JSON reports
+ * @param value the value to be reported
+ */
+void reportInt(struct report* pReport, const char* label, const char* key, long long value) {
+   if(pReport->json) {
+      printf("%s\"%s\":%lld", pReport->needsComma ? "," : "", key, value);
+      pReport->needsComma = true;
+   }
+   else {
+      printf("%s: %lld\n", label, value);
+   }
+}
+
+/**
+ * @brief Reports a decimal field to two places.
+ * 
+ * @param pReport the report being printed
+ * @param label the field's label in text reports
+ * @param key the field's key in JSON reports
+ * @param value the value to be reported
+ */
+void reportDecimal(struct report* pReport, const char* label, const char* key, double value) {
+   if(pReport->json) {
+      printf("%s\"%s\":%.2f", pReport->needsComma ? "," : "", key, value);
+      pReport->needsComma = true;
+   }
+   else {
+      printf("%s: %.2f\n", label, value);
+   }
+}
+
+/**
+ * @brief Decodes and reports a Broadcast Wave bext subchunk in place.
+ * 
+ * @param pReport the report being printed
+ * @param pBext a pointer to the bext subchunk
+ * @param sampleRate the file's sample rate, for converting the time reference to seconds
+ */
+void printBext(struct report* pReport, struct data* pBext, int sampleRate) {
+   const unsigned char* bext = pBext->subChunkData;
+   if(pBext->subChunk2Size < BEXTSIZE) {
+      return;
+   }
+   reportBegin(pReport, "BROADCAST EXTENSION", "bext", '{');
+   reportText(pReport, "Description", "description", bext, 256);
+   reportText(pReport, "Originator", "originator", bext + 256, 32);
+   reportText(pReport, "Originator Reference", "originatorReference", bext + 288, 32);
+   reportText(pReport, "Origination Date", "originationDate", bext + 320, 10);
+   reportText(pReport, "Origination Time", "originationTime", bext + 330, 8);
+   uint32_t timeReferenceLow, timeReferenceHigh;
+   uint16_t version;
+   memcpy(&timeReferenceLow, bext + 338, sizeof(timeReferenceLow));
+   memcpy(&timeReferenceHigh, bext + 342, sizeof(timeReferenceHigh));
+   memcpy(&version, bext + 346, sizeof(version));
+   uint64_t timeReference = (uint64_t)timeReferenceHigh << 32 | timeReferenceLow;
+   reportInt(pReport, "Time Reference (samples)", "timeReference", (long long)timeReference);
+   if(sampleRate > 0) {
+      reportDecimal(pReport, "Time Reference (seconds)", "timeReferenceSeconds", 
+                    (double)timeReference / sampleRate);
+   }
+   reportInt(pReport, "Version", "version", version);
+   //Loudness fields were added in version 2, in hundredths of a unit
+   if(version >= 2) {
+      const char* loudnessFields[5][2] = {
+         {"Loudness Value (LUFS)", "loudnessValue"}, {"Loudness Range (LU)", "loudnessRange"},
+         {"Max True Peak Level (dBTP)", "maxTruePeakLevel"}, 
+         {"Max Momentary Loudness (LUFS)", "maxMomentaryLoudness"},
+         {"Max Short-Term Loudness (LUFS)", "maxShortTermLoudness"}
+      };
+      for(int i = 0; i < 5; ++i) {
+         int16_t value;
+         memcpy(&value, bext + 412 + i * sizeof(value), sizeof(value));
+         reportDecimal(pReport, loudnessFields[i][0], loudnessFields[i][1], value / 100.0);
+      }
+   }
+   reportText(pReport, "Coding History", "codingHistory", bext + BEXTSIZE, 
+              pBext->subChunk2Size - BEXTSIZE);
+   reportEnd(pReport, '}');
+}
+
+/**
+ * @brief Decodes and reports the tags of a LIST/INFO subchunk in place.
+ * 
+ * @param pReport the report being printed
+ * @param pList a pointer to the LIST subchunk of type INFO
+ */
+void printInfo(struct report* pReport, struct data* pList) {
+   reportBegin(pReport, "INFO TAGS", "info", '{');
+   size_t seekArm = 4; //Skips the list type
+   while(seekArm + CHUNKHEADERSIZE <= (size_t)pList->subChunk2Size) {
+      const unsigned char* tag = pList->subChunkData + seekArm;
+      int tagSize;
+      memcpy(&tagSize, tag + 4, sizeof(tagSize));
+      if(tagSize < 0 || seekArm + CHUNKHEADERSIZE + tagSize > (size_t)pList->subChunk2Size) {
+         break;
+      }
+      char key[5] = {0}, label[64];
+      memcpy(key, tag, 4);
+      snprintf(label, sizeof(label), "%s", key);
+      for(int i = 0; i < NUMINFOTAGS; ++i) {
+         if(strncmp(key, INFOTAGS[i][0], 4) == 0) {
+            snprintf(label, sizeof(label), "%s (%s)", INFOTAGS[i][1], key);
+         }
+      }
+      reportText(pReport, label, key, tag + CHUNKHEADERSIZE, tagSize);
+      seekArm += CHUNKHEADERSIZE + tagSize + (tagSize & 1);
+   }
+   reportEnd(pReport, '}');
+}
+
+/**
+ * @brief Reports an iXML subchunk. Only a few well-known fields are located in the payload, which
+ *        is never copied; the whole payload is printed only with -ixml.
+ * 
+ * @param pReport the report being printed
+ * @param pIXML a pointer to the iXML subchunk
+ */
+void printIXML(struct report* pReport, struct data* pIXML) {
+   const char* payload = (const char*)pIXML->subChunkData;
+   size_t length = pIXML->subChunk2Size;
+   const char* fields[NUMIXMLFIELDS] = IXMLFIELDS;
+   reportBegin(pReport, "IXML", "ixml", '{');
+   reportInt(pReport, "iXML Size", "size", (long long)length);
+   for(int i = 0; i < NUMIXMLFIELDS; ++i) {
+      //Finds "<FIELD>" and reports the text up to the next '<'
+      size_t fieldLength = strlen(fields[i]);
+      for(size_t p = 0; p + fieldLength + 2 <= length; ++p) {
+         if(payload[p] == '<' && strncmp(payload + p + 1, fields[i], fieldLength) == 0 && 
+            payload[p + fieldLength + 1] == '>') {
+            size_t start = p + fieldLength + 2, end = start;
+            while(end < length && payload[end] != '<') {
+               ++end;
+            }
+            reportText(pReport, fields[i], fields[i], (const unsigned char*)payload + start, 
+                       end - start);
+            break;
+         }
+      }
+   }
+   if(fullIXML) {
+      reportText(pReport, "iXML", "payload", pIXML->subChunkData, length);
+   }
+   reportEnd(pReport, '}');
+}
+
+/**
+ * @brief Prints a formatted summary of the human-readable data in the .wav file, as text or, with
+ *        -json, as a single line of JSON
+ * 
+ * @param pSoundFile a pointer to the .wav file data to be printed
+ */
+void printFile(struct wav* pSoundFile) { 
+   struct riff fileRiff = pSoundFile->riffElements;
+   struct fmt fileFormat = pSoundFile->formatElements;
+   struct data fileData = pSoundFile->dataElements;
+   struct report fileReport = { jsonReport, false };
+   struct report* pReport = &fileReport;
+
+   reportBegin(pReport, NULL, NULL, '{');
+   reportBegin(pReport, "RIFF ELEMENTS", "riff", '{');
+   reportText(pReport, "ChunkID", "chunkID", (unsigned char*)fileRiff.chunkID, 4);
+   reportInt(pReport, "ChunkSize", "chunkSize", fileRiff.chunkSize);
+   reportText(pReport, "Format", "format", (unsigned char*)fileRiff.format, 4);
+   reportEnd(pReport, '}');
+
+   reportBegin(pReport, "FORMAT ELEMENTS", "format", '{');
+   reportText(pReport, "Subchunk1ID", "subChunk1ID", (unsigned char*)fileFormat.subChunk1ID, 3);
+   reportInt(pReport, "Subchunk1 Size", "subChunk1Size", fileFormat.subChunk1Size);
+   reportInt(pReport, "Audio Form", "audioForm", fileFormat.audioForm);
+   reportInt(pReport, "Number of Channels", "numChannels", fileFormat.numChannels);
+   reportInt(pReport, "Sample Rate", "sampleRate", fileFormat.sampleRate);
+   reportInt(pReport, "Byte Rate", "byteRate", fileFormat.byteRate);
+   reportInt(pReport, "Block Align", "blockAlign", fileFormat.blockAlign);
+   reportInt(pReport, "Bits Per Sample", "bitsPerSample", fileFormat.bitsPerSample);
+   reportText(pReport, "Extra Parameters", "extraParameters", 
+              (unsigned char*)(pSoundFile->extraParamsSize > 0 ? "Yes" : "No"), 3);
+   reportEnd(pReport, '}');
+
+   reportBegin(pReport, "DATA ELEMENTS", "data", '{');
+   reportText(pReport, "Subchunk2ID", "subChunk2ID", (unsigned char*)fileData.subChunk2ID, 4);
+   reportInt(pReport, "Subchunk2 Size", "subChunk2Size", fileData.subChunk2Size);
+   reportEnd(pReport, '}');
+
+   if(!pReport->json) {
+      printf("\nExtra Subchunks Found: %d \n", pSoundFile->numExtraSubChunks);
+   }
+   reportBegin(pReport, NULL, "extraChunks", '[');
+   for(int i = 0; i < pSoundFile->numExtraSubChunks; ++i) {
+      struct data* subChunk = &pSoundFile->extraChunks[i];
+      if(pReport->json) {
+         reportBegin(pReport, NULL, NULL, '{');
+         reportText(pReport, "ID", "id", (unsigned char*)subChunk->subChunk2ID, 4);
+         reportInt(pReport, "Size", "size", subChunk->subChunk2Size);
+         reportEnd(pReport, '}');
+      }
+      else {
+         printf("Extra Subchunk Names: %.4s of Size %d\n", subChunk->subChunk2ID, 
+                subChunk->subChunk2Size);
+      }
+   }
+   reportEnd(pReport, ']');
+
+   //Metadata subchunks are decoded straight from the file's memory, only when reported
+   struct data* subChunk = findSubChunk(pSoundFile, "bext", NULL);
+   if(subChunk) {
+      printBext(pReport, subChunk, fileFormat.sampleRate);
+   }
+   subChunk = findSubChunk(pSoundFile, "LIST", "INFO");
+   if(subChunk) {
+      printInfo(pReport, subChunk);
+   }
+   subChunk = findSubChunk(pSoundFile, "iXML", NULL);
+   if(subChunk) {
+      printIXML(pReport, subChunk);
+   }
+   printMarkers(pReport, pSoundFile);
+   if(!pReport->json) {
+      printf("\n");
+   }
+   reportText(pReport, "Sample Kernels", "sampleKernels", 
+              (unsigned char*)getSampleKernels(pSoundFile)->name, 64);
+   reportText(pReport, "Kernel Level", "kernelLevel", (unsigned char*)ISANAMES[kernelLevel], 16);
+   reportEnd(pReport, '}');
+   printf("\n");
+}
+
+/**
+ * @brief Records the tag edit in the two command-line arguments following a -tag flag: a
+ *        four-character LIST/INFO tag ID and its new value. An empty value removes the tag.
+ * 
+ * @param index the index at which the tag ID resides
+ */
+void addTagEdit(size_t index, int argc, char* argv[]) {
+   if(index + 1 >= argc) {
+      printf("No tag specified. Please see README for usage.");
+      exit(1);
+   }
+   if(strlen(argv[index]) != 4) {
+      printf("Invalid tag %s. Tags are four-character IDs such as INAM.", argv[index]);
+      exit(1);
+   }
+   if(numTagEdits == MAXTAGEDITS) {
+      printf("dWAV can edit at most %d tags at once.", MAXTAGEDITS);
+      exit(1);
+   }
+   memcpy(tagEdits[numTagEdits].tagID, argv[index], 4);
+   tagEdits[numTagEdits].value = argv[index + 1];
+   ++numTagEdits;
+}
+
+/**
+ * @brief Checks to make sure there is a valid (nonnegative) size in the command-line argument
+ *        following a -junk flag.
+ * 
+ * @param index the index at which the desired size resides
+ */
+void validateJunkSize(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No JUNK size specified. Please see README for usage.");
+      exit(1);
+   }
+   if(atoi(argv[index]) < 0 || (atoi(argv[index]) == 0 && strcmp(argv[index], "0") != 0)) {
+      printf("Invalid JUNK size %s. Sizes must be nonnegative integers.", argv[index]);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Checks to make sure there is a valid sector size (a positive even integer) in the
+ *        command-line argument following a -sector flag.
+ * 
+ * @param index the index at which the desired sector size resides
+ * @return int the sector size
+ */
+int validateSectorSize(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No sector size specified. Please see README for usage.");
+      exit(1);
+   }
+   int sectorSize = atoi(argv[index]);
+   //Subchunks always start on even offsets, so only even boundaries can be reached
+   if(sectorSize <= 0 || sectorSize % 2 != 0) {
+      printf("Invalid sector size %s. Sector sizes must be positive even integers.", argv[index]);
+      exit(1);
+   }
+   return sectorSize;
+}
+
+/**
+ * @brief Determines whether a subchunk only reserves space, and so can be overwritten freely.
+ * 
+ * @param subChunk a pointer to the subchunk to be checked
+ * @return true if the subchunk is a JUNK, PAD or FLLR subchunk
+ *         false otherwise
+ */
+bool isPaddingSubChunk(const struct data* subChunk) {
+   return strncmp(subChunk->subChunk2ID, "JUNK", 4) == 0 || 
+          strncmp(subChunk->subChunk2ID, "junk", 4) == 0 || 
+          strncmp(subChunk->subChunk2ID, "PAD ", 4) == 0 || 
+          strncmp(subChunk->subChunk2ID, "FLLR", 4) == 0;
+}
+
+/**
+ * @brief Rebuilds the LIST/INFO subchunk with the tag edits applied, keeping every other tag in
+ *        its original order. An edited tag the file holds more than once keeps only its first
+ *        place. A file without tags gets a new LIST subchunk after its data.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose tags are to be edited
+ */
+void applyTagEdits(struct wav* pSoundFile) {
+   struct data* pList = findSubChunk(pSoundFile, "LIST", "INFO");
+   size_t capacity = 4 + (pList ? pList->subChunk2Size : 0);
+   for(int i = 0; i < numTagEdits; ++i) {
+      capacity += CHUNKHEADERSIZE + strlen(tagEdits[i].value) + 2;
+   }
+   unsigned char* info = (unsigned char*)malloc(capacity);
+   if(!info) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   memcpy(info, "INFO", 4);
+   size_t length = 4;
+   bool applied[MAXTAGEDITS] = {false};
+   //Copies the existing tags, substituting edited values; the last edit of a tag wins
+   for(size_t seekArm = 4; pList && seekArm + CHUNKHEADERSIZE <= (size_t)pList->subChunk2Size; ) {
+      const unsigned char* tag = pList->subChunkData + seekArm;
+      int oldTagSize;
+      memcpy(&oldTagSize, tag + 4, sizeof(oldTagSize));
+      if(oldTagSize < 0 || seekArm + CHUNKHEADERSIZE + oldTagSize > (size_t)pList->subChunk2Size) {
+         break;
+      }
+      int tagSize = oldTagSize;
+      const unsigned char* value = tag + CHUNKHEADERSIZE;
+      int edit = -1;
+      bool duplicate = false;
+      for(int i = 0; i < numTagEdits; ++i) {
+         if(strncmp((const char*)tag, tagEdits[i].tagID, 4) == 0) {
+            edit = i;
+            duplicate = applied[i];
+            applied[i] = true;
+         }
+      }
+      //The buffer only has room for each edited value once
+      if(duplicate) {
+         tagSize = 0;
+      }
+      else if(edit >= 0) {
+         value = (const unsigned char*)tagEdits[edit].value;
+         tagSize = *tagEdits[edit].value ? (int)strlen(tagEdits[edit].value) + 1 : 0;
+      }
+      if(tagSize > 0) {
+         memcpy(info + length, tag, 4);
+         memcpy(info + length + 4, &tagSize, sizeof(tagSize));
+         memcpy(info + length + CHUNKHEADERSIZE, value, tagSize);
+         length += CHUNKHEADERSIZE + tagSize;
+         if(tagSize & 1) {
+            info[length++] = '\0';
+         }
+      }
+      seekArm += CHUNKHEADERSIZE + oldTagSize + (oldTagSize & 1);
+   }
+   //Appends the tags the file did not have yet
+   for(int i = 0; i < numTagEdits; ++i) {
+      bool later = false;
+      for(int j = i + 1; j < numTagEdits; ++j) {
+         later |= strncmp(tagEdits[i].tagID, tagEdits[j].tagID, 4) == 0;
+      }
+      if(applied[i] || later || !*tagEdits[i].value) {
+         continue;
+      }
+      int tagSize = (int)strlen(tagEdits[i].value) + 1;
+      memcpy(info + length, tagEdits[i].tagID, 4);
+      memcpy(info + length + 4, &tagSize, sizeof(tagSize));
+      memcpy(info + length + CHUNKHEADERSIZE, tagEdits[i].value, tagSize);
+      length += CHUNKHEADERSIZE + tagSize;
+      if(tagSize & 1) {
+         info[length++] = '\0';
+      }
+   }
+   if(!pList) {
+      if(pSoundFile->numExtraSubChunks == MAXEXTRASUBCHUNKS) {
+         printf("Too many extra subchunks to add tags.");
+         exit(1);
+      }
+      pList = &pSoundFile->extraChunks[pSoundFile->numExtraSubChunks++];
+      memcpy(pList->subChunk2ID, "LIST", 4);
+   }
+   pList->subChunkData = info;
+   pList->subChunk2Size = (int)length;
+   pSoundFile->editedInfo = info;
+}
+
+/**
+ * @brief Decodes and reports the cue points and sample loops of a file in place, if it has any.
+ * 
+ * @param pReport the report being printed
+ * @param pSoundFile a pointer to the wav struct whose markers are to be reported
+ */
+void printMarkers(struct report* pReport, struct wav* pSoundFile) {
+   struct data* pCue = findSubChunk(pSoundFile, "cue ", NULL);
+   struct data* pSmpl = findSubChunk(pSoundFile, "smpl", NULL);
+   if(!pCue && !pSmpl) {
+      return;
+   }
+   reportBegin(pReport, "MARKERS", "markers", '{');
+   reportBegin(pReport, NULL, "cuePoints", '[');
+   int numCues = 0;
+   if(pCue && pCue->subChunk2Size >= 4) {
+      memcpy(&numCues, pCue->subChunkData, sizeof(numCues));
+   }
+   for(int i = 0; i < numCues && 4 + (size_t)(i + 1) * CUEPOINTSIZE <= pCue->subChunk2Size; ++i) {
+      const unsigned char* cue = pCue->subChunkData + 4 + (size_t)i * CUEPOINTSIZE;
+      uint32_t cueID, sampleOffset;
+      memcpy(&cueID, cue, sizeof(cueID));
+      memcpy(&sampleOffset, cue + 20, sizeof(sampleOffset));
+      reportBegin(pReport, NULL, NULL, '{');
+      reportInt(pReport, "Cue Point", "id", cueID);
+      reportInt(pReport, "Sample Offset", "sampleOffset", sampleOffset);
+      reportEnd(pReport, '}');
+   }
+   reportEnd(pReport, ']');
+   reportBegin(pReport, NULL, "loops", '[');
+   int numLoops = 0;
+   if(pSmpl && pSmpl->subChunk2Size >= SMPLHEADERSIZE) {
+      memcpy(&numLoops, pSmpl->subChunkData + 28, sizeof(numLoops));
+   }
+   for(int i = 0; i < numLoops && 
+                  SMPLHEADERSIZE + (size_t)(i + 1) * SMPLLOOPSIZE <= pSmpl->subChunk2Size; ++i) {
+      const unsigned char* loop = pSmpl->subChunkData + SMPLHEADERSIZE + (size_t)i * SMPLLOOPSIZE;
+      uint32_t start, end;
+      memcpy(&start, loop + 8, sizeof(start));
+      memcpy(&end, loop + 12, sizeof(end));
+      reportBegin(pReport, NULL, NULL, '{');
+      reportInt(pReport, "Loop Start", "start", start);
+      reportInt(pReport, "Loop End", "end", end);
+      reportEnd(pReport, '}');
+   }
+   reportEnd(pReport, ']');
+   reportEnd(pReport, '}');
+}
+
+/**
+ * @brief Checks to make sure there is a valid frame range in the two command-line arguments
+ *        following a -trim flag: a first frame and an end frame, the end not included.
+ * 
+ * @param index the index at which the first frame resides
+ */
+void validateTrimRange(size_t index, int argc, char* argv[]) {
+   if(index + 1 >= argc) {
+      printf("No trim range specified. Please see README for usage.");
+      exit(1);
+   }
+   for(int i = 0; i < 2; ++i) {
+      if(argv[index + i][strspn(argv[index + i], "0123456789")] != '\0' || !*argv[index + i]) {
+         printf("Invalid frame %s. Frames must be nonnegative integers.", argv[index + i]);
+         exit(1);
+      }
+   }
+   if(strtoull(argv[index], NULL, 10) >= strtoull(argv[index + 1], NULL, 10)) {
+      printf("Invalid trim range %s to %s. The range must not be empty.", argv[index], 
+             argv[index + 1]);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Cuts the sound data in the passed wav struct down to a range of frames. No samples are
+ *        moved; the data subchunk is narrowed to the range where it lies in memory.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose data is to be trimmed
+ * @param startFrame the first frame kept, counted in the data's current order
+ * @param endFrame the frame after the last frame kept
+ * @param storedReversed whether the frames in memory are still in the reverse of their current
+ *        order, as in mapped mode where reversal is deferred into the write
+ */
+void trimFile(struct wav* pSoundFile, size_t startFrame, size_t endFrame, bool storedReversed) {
+   struct frameMap* pMap = &pSoundFile->frames;
+   int blockSize = pSoundFile->formatElements.blockAlign;
+   if(blockSize <= 0 || endFrame > pMap->numFrames) {
+      printf("Error trimming the file to frames %zu to %zu of %zu.", startFrame, endFrame, 
+             pMap->numFrames);
+      exit(1);
+   }
+   size_t storedStart = storedReversed ? pMap->numFrames - endFrame : startFrame;
+   pSoundFile->dataElements.subChunkData += storedStart * blockSize;
+   pSoundFile->dataElements.subChunk2Size = (int)((endFrame - startFrame) * blockSize);
+   pMap->firstFrame += pMap->reversed ? pMap->numFrames - endFrame : startFrame;
+   pMap->numFrames = endFrame - startFrame;
+}
+
+/**
+ * @brief Maps a range of frames of the input's data to where it lands in the output's data,
+ *        scaling it with any stretch and cutting off whatever lies outside the frames kept. An
+ *        empty range marks a single position between frames.
+ * 
+ * @param pMap a pointer to the frame map of the output
+ * @param pStart holds the first frame of the range, replaced with the mapped first frame
+ * @param pEnd holds the frame after the range, replaced with the mapped frame after the range
+ * @return true if any of the range, or the position, is kept.
+ *         false otherwise, or if the position is at an end shared with the frames written next.
+ */
+bool mapFrameRange(const struct frameMap* pMap, size_t* pStart, size_t* pEnd) {
+   if(pMap->scale != 1) {
+      *pStart = (size_t)(*pStart * pMap->scale + 0.5);
+      *pEnd = (size_t)(*pEnd * pMap->scale + 0.5);
+   }
+   size_t lastFrame = pMap->firstFrame + pMap->numFrames;
+   size_t start = *pStart > pMap->firstFrame ? *pStart : pMap->firstFrame;
+   size_t end = *pEnd < lastFrame ? *pEnd : lastFrame;
+   if(start > end || (start == end && *pStart != *pEnd)) {
+      return false;
+   }
+   start -= pMap->firstFrame;
+   end -= pMap->firstFrame;
+   *pStart = pMap->reversed ? pMap->numFrames - end : start;
+   *pEnd = pMap->reversed ? pMap->numFrames - start : end;
+   return !pMap->endShared || *pStart < pMap->numFrames;
+}
+
+/**
+ * @brief Rebuilds the cue, smpl and LIST/adtl subchunks so every marker points at the same
+ *        sound after the file's frames were reversed, trimmed or stretched. Regions and loops
+ *        are cut to the frames kept, markers outside them are dropped along with their labels,
+ *        and everything else in the subchunks is kept as-is. Files whose frames were not moved
+ *        are left alone.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose markers are to be remapped
+ */
+void remapMarkers(struct wav* pSoundFile) {
+   const struct frameMap* pMap = &pSoundFile->frames;
+   if(pMap->firstFrame == 0 && pMap->numFrames == pMap->sourceFrames && !pMap->reversed && 
+      pMap->scale == 1) {
+      return;
+   }
+   struct data* pCue = findSubChunk(pSoundFile, "cue ", NULL);
+   struct data* pSmpl = findSubChunk(pSoundFile, "smpl", NULL);
+   struct data* pAdtl = findSubChunk(pSoundFile, "LIST", "adtl");
+   //Markers are only ever dropped or changed, so the rebuilt subchunks fit in the old space
+   size_t capacity = (pCue ? pCue->subChunk2Size : 0) + (pSmpl ? pSmpl->subChunk2Size : 0) + 
+                     (pAdtl ? pAdtl->subChunk2Size : 0);
+   if(capacity == 0) {
+      return;
+   }
+   unsigned char* markers = (unsigned char*)malloc(capacity);
+   int numCues = 0;
+   if(pCue && pCue->subChunk2Size >= 4) {
+      memcpy(&numCues, pCue->subChunkData, sizeof(numCues));
+      int maxCues = (pCue->subChunk2Size - 4) / CUEPOINTSIZE;
+      numCues = numCues < 0 ? 0 : numCues < maxCues ? numCues : maxCues;
+   }
+   //Region lengths of the cue points, and whether each is kept, in cue order
+   uint32_t* regionLengths = (uint32_t*)calloc(numCues + 1, sizeof(uint32_t));
+   bool* kept = (bool*)calloc(numCues + 1, sizeof(bool));
+   const unsigned char* oldCues = pCue ? pCue->subChunkData + 4 : NULL;
+   if(!markers || !regionLengths || !kept) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   size_t length = 0;
+
+   //A labelled text entry gives its cue point a length, making it a region
+   for(size_t seekArm = 4; pAdtl && seekArm + CHUNKHEADERSIZE + 8 <= pAdtl->subChunk2Size; ) {
+      const unsigned char* entry = pAdtl->subChunkData + seekArm;
+      int entrySize;
+      memcpy(&entrySize, entry + 4, sizeof(entrySize));
+      if(entrySize < 0 || seekArm + CHUNKHEADERSIZE + entrySize > pAdtl->subChunk2Size) {
+         break;
+      }
+      for(int i = 0; i < numCues && strncmp((const char*)entry, "ltxt", 4) == 0 && 
+                     entrySize >= 8; ++i) {
+         if(memcmp(oldCues + (size_t)i * CUEPOINTSIZE, 
+                   entry + CHUNKHEADERSIZE, 4) == 0) {
+            memcpy(&regionLengths[i], entry + CHUNKHEADERSIZE + 4, sizeof(uint32_t));
+         }
+      }
+      seekArm += CHUNKHEADERSIZE + entrySize + (entrySize & 1);
+   }
+
+   if(pCue && pCue->subChunk2Size >= 4) {
+      unsigned char* cues = markers + length;
+      int numKept = 0;
+      for(int i = 0; i < numCues; ++i) {
+         unsigned char* cue = cues + 4 + (size_t)numKept * CUEPOINTSIZE;
+         memcpy(cue, oldCues + (size_t)i * CUEPOINTSIZE, CUEPOINTSIZE);
+         uint32_t position, sampleOffset;
+         memcpy(&position, cue + 4, sizeof(position));
+         memcpy(&sampleOffset, cue + 20, sizeof(sampleOffset));
+         size_t start = sampleOffset, end = (size_t)sampleOffset + regionLengths[i];
+         if(!mapFrameRange(pMap, &start, &end)) {
+            continue;
+         }
+         //The play order position matches the sample offset unless a playlist reorders it
+         if(position == sampleOffset) {
+            position = (uint32_t)start;
+            memcpy(cue + 4, &position, sizeof(position));
+         }
+         sampleOffset = (uint32_t)start;
+         memcpy(cue + 20, &sampleOffset, sizeof(sampleOffset));
+         regionLengths[i] = (uint32_t)(end - start);
+         kept[i] = true;
+         ++numKept;
+      }
+      memcpy(cues, &numKept, sizeof(numKept));
+      pCue->subChunkData = cues;
+      pCue->subChunk2Size = 4 + numKept * CUEPOINTSIZE;
+      length += pCue->subChunk2Size;
+   }
+
+   if(pSmpl && pSmpl->subChunk2Size >= SMPLHEADERSIZE) {
+      unsigned char* smpl = markers + length;
+      int numLoops, samplerDataSize;
+      memcpy(smpl, pSmpl->subChunkData, SMPLHEADERSIZE);
+      memcpy(&numLoops, smpl + 28, sizeof(numLoops));
+      memcpy(&samplerDataSize, smpl + 32, sizeof(samplerDataSize));
+      int maxLoops = (pSmpl->subChunk2Size - SMPLHEADERSIZE) / SMPLLOOPSIZE;
+      numLoops = numLoops < 0 ? 0 : numLoops < maxLoops ? numLoops : maxLoops;
+      int numKept = 0;
+      for(int i = 0; i < numLoops; ++i) {
+         unsigned char* loop = smpl + SMPLHEADERSIZE + (size_t)numKept * SMPLLOOPSIZE;
+         memcpy(loop, pSmpl->subChunkData + SMPLHEADERSIZE + (size_t)i * SMPLLOOPSIZE, 
+                SMPLLOOPSIZE);
+         //Loops include their end frame
+         uint32_t loopStart, loopEnd;
+         memcpy(&loopStart, loop + 8, sizeof(loopStart));
+         memcpy(&loopEnd, loop + 12, sizeof(loopEnd));
+         size_t start = loopStart, end = (size_t)loopEnd + 1;
+         if(loopEnd < loopStart || !mapFrameRange(pMap, &start, &end) || start == end) {
+            continue;
+         }
+         loopStart = (uint32_t)start;
+         loopEnd = (uint32_t)(end - 1);
+         memcpy(loop + 8, &loopStart, sizeof(loopStart));
+         memcpy(loop + 12, &loopEnd, sizeof(loopEnd));
+         ++numKept;
+      }
+      memcpy(smpl + 28, &numKept, sizeof(numKept));
+      //Any sampler-specific data after the loops is kept as-is
+      size_t loopsEnd = SMPLHEADERSIZE + (size_t)numLoops * SMPLLOOPSIZE;
+      size_t extra = pSmpl->subChunk2Size - loopsEnd;
+      memcpy(smpl + SMPLHEADERSIZE + (size_t)numKept * SMPLLOOPSIZE, 
+             pSmpl->subChunkData + loopsEnd, extra);
+      pSmpl->subChunkData = smpl;
+      pSmpl->subChunk2Size = (int)(SMPLHEADERSIZE + (size_t)numKept * SMPLLOOPSIZE + extra);
+      length += pSmpl->subChunk2Size;
+   }
+
+   if(pAdtl) {
+      unsigned char* adtl = markers + length;
+      memcpy(adtl, "adtl", 4);
+      size_t adtlLength = 4;
+      for(size_t seekArm = 4; seekArm + CHUNKHEADERSIZE <= pAdtl->subChunk2Size; ) {
+         const unsigned char* entry = pAdtl->subChunkData + seekArm;
+         int entrySize;
+         memcpy(&entrySize, entry + 4, sizeof(entrySize));
+         if(entrySize < 0 || seekArm + CHUNKHEADERSIZE + entrySize > pAdtl->subChunk2Size) {
+            break;
+         }
+         size_t paddedSize = CHUNKHEADERSIZE + entrySize + (entrySize & 1);
+         paddedSize = seekArm + paddedSize <= pAdtl->subChunk2Size ? paddedSize : 
+                                                                    CHUNKHEADERSIZE + entrySize;
+         seekArm += paddedSize;
+         //Labels, notes and labelled text all start with the ID of the cue point they belong to
+         int cue = -1;
+         for(int i = 0; i < numCues && entrySize >= 4; ++i) {
+            if(memcmp(oldCues + (size_t)i * CUEPOINTSIZE, 
+                      entry + CHUNKHEADERSIZE, 4) == 0) {
+               cue = i;
+            }
+         }
+         if(cue >= 0 && !kept[cue]) {
+            continue;
+         }
+         memcpy(adtl + adtlLength, entry, paddedSize);
+         if(cue >= 0 && strncmp((const char*)entry, "ltxt", 4) == 0 && entrySize >= 8) {
+            memcpy(adtl + adtlLength + CHUNKHEADERSIZE + 4, &regionLengths[cue], sizeof(uint32_t));
+         }
+         adtlLength += paddedSize;
+      }
+      pAdtl->subChunkData = adtl;
+      pAdtl->subChunk2Size = (int)adtlLength;
+      length += adtlLength;
+   }
+   free(regionLengths);
+   free(kept);
+   free(pSoundFile->remappedMarkers);
+   pSoundFile->remappedMarkers = markers;
+}
+
+/**
+ * @brief Writes the rebuilt LIST/INFO subchunk back into the input file in place. It may take
+ *        the space of the old LIST subchunk plus any padding subchunks directly after it, or
+ *        without an old LIST subchunk the space of any padding subchunk. Whatever space is left
+ *        over becomes a JUNK subchunk.
+ * 
+ * @param filename the name of the file to be edited
+ * @param pSoundFile a pointer to the wav struct holding the rebuilt LIST subchunk
+ */
+void writeTagsInPlace(char* filename, struct wav* pSoundFile) {
+   struct data* pList = NULL;
+   for(int i = 0; i < pSoundFile->numExtraSubChunks; ++i) {
+      if(pSoundFile->extraChunks[i].subChunkData == pSoundFile->editedInfo) {
+         pList = &pSoundFile->extraChunks[i];
+      }
+   }
+   size_t needed = CHUNKHEADERSIZE + pList->subChunk2Size + (pList->subChunk2Size & 1);
+   size_t regionStart = 0, regionLength = 0;
+   //The wav struct now points at the rebuilt contents, so the old LIST subchunk and the padding
+   //directly after it are found by walking the file's own headers again
+   for(size_t seekArm = sizeof(struct riff); seekArm + CHUNKHEADERSIZE <= pSoundFile->fileLength;) {
+      unsigned char* header = pSoundFile->fileBytes + seekArm;
+      int size;
+      memcpy(&size, header + 4, sizeof(size));
+      if(size < 0) {
+         break;
+      }
+      size_t total = CHUNKHEADERSIZE + (size_t)size + (size & 1);
+      bool isInfo = strncmp((char*)header, "LIST", 4) == 0 && size >= 4 && 
+                    strncmp((char*)header + CHUNKHEADERSIZE, "INFO", 4) == 0;
+      struct data subChunk;
+      memcpy(subChunk.subChunk2ID, header, 4);
+      if(regionLength == 0 && isInfo) {
+         regionStart = seekArm;
+         regionLength = total;
+      }
+      else if(regionLength > 0 && isPaddingSubChunk(&subChunk)) {
+         regionLength += total; //Padding directly after the old LIST is free to use
+      }
+      else if(regionLength > 0) {
+         break;
+      }
+      seekArm += total;
+   }
+   //Otherwise any padding subchunk large enough will do, such as one reserved with -junk, and
+   //the old LIST subchunk is renamed to JUNK
+   size_t oldListStart = regionStart;
+   bool oldListMoved = false;
+   size_t fits = regionLength - needed;
+   if(regionLength < needed || (fits > 0 && fits < CHUNKHEADERSIZE)) {
+      oldListMoved = regionLength > 0;
+      regionLength = 0;
+      for(int i = 0; i < pSoundFile->numExtraSubChunks; ++i) {
+         struct data* subChunk = &pSoundFile->extraChunks[i];
+         size_t total = CHUNKHEADERSIZE + subChunk->subChunk2Size + (subChunk->subChunk2Size & 1);
+         size_t leftover = total - needed;
+         if(subChunk != pList && isPaddingSubChunk(subChunk) && total >= needed && 
+            (leftover == 0 || leftover >= CHUNKHEADERSIZE)) {
+            regionStart = subChunk->subChunkData - CHUNKHEADERSIZE - pSoundFile->fileBytes;
+            regionLength = total;
+            break;
+         }
+      }
+   }
+   size_t leftover = regionLength - needed;
+   if(regionLength < needed || (leftover > 0 && leftover < CHUNKHEADERSIZE)) {
+      printf("The edited tags do not fit in place in %s. Rewrite it with -o, using -junk to "
+             "reserve room for later edits.", filename);
+      exit(1);
+   }
+   unsigned char* region = (unsigned char*)calloc(1, regionLength);
+   if(!region) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   memcpy(region, pList, CHUNKHEADERSIZE);
+   memcpy(region + CHUNKHEADERSIZE, pList->subChunkData, pList->subChunk2Size);
+   if(leftover > 0) {
+      int junkSize = (int)(leftover - CHUNKHEADERSIZE);
+      memcpy(region + needed, "JUNK", 4);
+      memcpy(region + needed + 4, &junkSize, sizeof(junkSize));
+   }
+   int filehandle = open(filename, O_WRONLY | O_BINARY);
+   if(filehandle == -1) {
+      printf("Error opening %s for editing", filename);
+      exit(1);
+   }
+#ifdef _WIN32
+   lseek(filehandle, regionStart, SEEK_SET);
+   long bytesWritten = write(filehandle, region, regionLength);
+   if(oldListMoved) {
+      lseek(filehandle, oldListStart, SEEK_SET);
+      bytesWritten += write(filehandle, "JUNK", 4);
+   }
+#else
+   long bytesWritten = pwrite(filehandle, region, regionLength, regionStart);
+   if(oldListMoved) {
+      bytesWritten += pwrite(filehandle, "JUNK", 4, oldListStart);
+   }
+#endif
+   if(bytesWritten != (long)regionLength + (oldListMoved ? 4 : 0)) {
+      printf("Error editing %s", filename);
+      exit(1);
+   }
+   fprintf(statusStream(), "Edited %ld bytes in place in %s\n", bytesWritten, filename);
+   close(filehandle);
+   free(region);
+}
+
+/**
+ * @brief Changes the sample rate of the passed .wav file, altering the byte rate to match it.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose sample rate is to be changed
+ * @param newSampleRate the desired sample rate
+ */
+void changeSampleRate(struct wav* pSoundFile, int newSampleRate) {
+   pSoundFile->formatElements.sampleRate = newSampleRate;
+   pSoundFile->formatElements.byteRate = (newSampleRate * pSoundFile->formatElements.blockAlign);
+}
+
+/**
+ * @brief Checks to make sure there is a valid speed in the command-line argument following a
+ *        -speed flag.
+ * 
+ * @param index the index at which the desired speed resides
+ */
+void validateSpeed(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No speed specified. Please see README for usage.");
+      exit(1);
+   }
+   char* end;
+   double speed = strtod(argv[index], &end);
+   if(end == argv[index] || *end != '\0' || !(speed >= MINSPEED && speed <= MAXSPEED)) {
+      printf("Invalid speed %s. Speeds must be between %g and %g.", argv[index], MINSPEED, 
+             MAXSPEED);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Changes the speed of the passed .wav file without changing its pitch, by WSOLA. The
+ *        input is streamed through a sliding window of float frames and the stretched frames are
+ *        written into a new data buffer owned by the wav struct. Markers are remapped to the
+ *        stretched frames.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose speed is to be changed
+ * @param speed the factor the speed is multiplied by, above 1 to shorten the file
+ * @param storedReversed whether the frames in memory are in the reverse of their current order, 
+ *        in which case they are read from the end and the stretched frames stored the same way
+ */
+void changeSpeed(struct wav* pSoundFile, double speed, bool storedReversed) {
+   const struct sampleKernels* kernels = getSampleKernels(pSoundFile);
+   if(!kernels->toFloat) {
+      printf("Time-stretching is not supported for this sample format.");
+      exit(1);
+   }
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   int numChannels = pSoundFile->formatElements.numChannels;
+   const struct sampleKernels* floatFrames =
+      &SAMPLEKERNELS[kernelLevel][KERNELSF32 + (numChannels < 3 ? numChannels - 1 : 2)];
+   size_t frameSize = (size_t)kernels->bytesPerSample * numChannels;
+   size_t numFrames = pSoundFile->frames.numFrames;
+   size_t outFrames = (size_t)(numFrames / speed + 0.5);
+   size_t hop = (size_t)pSoundFile->formatElements.sampleRate * WSOLASEGMENTMS / 2000;
+   hop = hop < 8 ? 8 : hop;
+   size_t segmentFrames = 2 * hop, tolerance = hop / 2;
+   double inputHop = hop * speed;
+
+   //Markers are remapped to the frames as they are now before the stretch is layered on top
+   remapMarkers(pSoundFile);
+   struct stretchInput input = { pSoundFile->dataElements.subChunkData, numFrames, numChannels, 
+                                 kernels, storedReversed };
+   input.capacity = (size_t)inputHop + 2 * tolerance + 2 * segmentFrames + 2;
+   input.frames = (float*)malloc(input.capacity * numChannels * sizeof(float));
+   unsigned char* stretched = (unsigned char*)malloc(outFrames * frameSize + 1);
+   float* window = (float*)malloc(segmentFrames * sizeof(float));
+   float* overlap = (float*)malloc(hop * numChannels * sizeof(float));
+   float* block = (float*)malloc(hop * numChannels * sizeof(float));
+   if(!input.frames || !stretched || !window || !overlap || !block) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   //A periodic Hann window, whose halves sum to 1 when segments overlap by half
+   const double pi = 3.14159265358979323846;
+   for(size_t i = 0; i < segmentFrames; ++i) {
+      window[i] = (float)(0.5 - 0.5 * cos(2 * pi * i / segmentFrames));
+   }
+
+   size_t previousStart = 0;
+   for(size_t k = 0, done = 0; done < outFrames; ++k) {
+      size_t start = 0;
+      float* segment;
+      if(k == 0) {
+         //The first segment continues a virtual one that ends where it starts, so it fades in
+         //at full level
+         segment = fetchFrames(&input, 0, segmentFrames);
+         for(size_t i = 0; i < hop * numChannels; ++i) {
+            overlap[i] = (1 - window[i / numChannels]) * segment[i];
+         }
+      }
+      else {
+         //Search around the nominal start for the lag whose first half best matches the
+         //natural continuation of the previous segment, by normalized cross-correlation
+         size_t nominal = (size_t)(k * inputHop + 0.5);
+         size_t lowest = nominal > tolerance ? nominal - tolerance : 0;
+         size_t highest = nominal + tolerance;
+         size_t continuation = previousStart + hop;
+         size_t first = continuation < lowest ? continuation : lowest;
+         float* frames = fetchFrames(&input, first, highest + segmentFrames);
+         const float* target = frames + (continuation - first) * numChannels;
+         size_t length = hop * numChannels;
+         const float* candidate = frames + (lowest - first) * numChannels;
+         double energy = floatKernels->dot(candidate, candidate, length);
+         double bestScore = -INFINITY;
+         for(size_t lag = lowest; lag <= highest; ++lag, candidate += numChannels) {
+            double correlation = floatKernels->dot(target, candidate, length);
+            double score = correlation / sqrt(energy > 1e-9 ? energy : 1e-9);
+            if(score > bestScore) {
+               bestScore = score;
+               start = lag;
+            }
+            //Slide the candidate's energy one frame along
+            for(int c = 0; c < numChannels; ++c) {
+               energy += candidate[length + c] * candidate[length + c] - 
+                         candidate[c] * candidate[c];
+            }
+         }
+         segment = frames + (start - first) * numChannels;
+      }
+      for(size_t i = 0; i < hop * numChannels; ++i) {
+         block[i] = overlap[i] + window[i / numChannels] * segment[i];
+         overlap[i] = window[hop + i / numChannels] * segment[hop * numChannels + i];
+      }
+      size_t blockFrames = outFrames - done < hop ? outFrames - done : hop;
+      size_t stored = done;
+      if(storedReversed) {
+         floatFrames->reverse((unsigned char*)block, blockFrames, 0, blockFrames / 2, 
+                              numChannels);
+         stored = outFrames - done - blockFrames;
+      }
+      kernels->fromFloat(block, stretched + stored * frameSize, blockFrames * numChannels);
+      done += blockFrames;
+      previousStart = start;
+   }
+   free(input.frames);
+   free(window);
+   free(overlap);
+   free(block);
+   free(pSoundFile->rebuiltData);
+   pSoundFile->rebuiltData = stretched;
+   pSoundFile->dataElements.subChunkData = stretched;
+   pSoundFile->dataElements.subChunk2Size = (int)(outFrames * frameSize);
+   pSoundFile->frames = (struct frameMap){ 0, outFrames, outFrames, false, 
+                                           numFrames > 0 ? (double)outFrames / numFrames : 1, 
+                                           false };
+   pSoundFile->samplesAltered = true;
+}
+
+/**
+ * @brief Makes a range of frames of a stretch's input available as float frames in playing
+ *        order. The window only slides forward: frames it already holds are kept and only the
+ *        rest are converted. Frames past the end of the input read as silence.
+ * 
+ * @param pInput a pointer to the input window
+ * @param firstFrame the first frame needed
+ * @param lastFrame the frame after the last frame needed
+ * @return float* a pointer to the first frame needed
+ */
+float* fetchFrames(struct stretchInput* pInput, size_t firstFrame, size_t lastFrame) {
+   int numChannels = pInput->numChannels;
+   if(firstFrame < pInput->firstFrame || lastFrame > pInput->firstFrame + pInput->capacity) {
+      size_t loadedEnd = pInput->firstFrame + pInput->numLoaded;
+      size_t keep = firstFrame >= pInput->firstFrame && firstFrame < loadedEnd ? 
+                    loadedEnd - firstFrame : 0;
+      if(keep > 0) {
+         memmove(pInput->frames, pInput->frames + (firstFrame - pInput->firstFrame) * numChannels, 
+                 keep * numChannels * sizeof(float));
+      }
+      pInput->firstFrame = firstFrame;
+      pInput->numLoaded = keep;
+   }
+   size_t loadedEnd = pInput->firstFrame + pInput->numLoaded;
+   if(lastFrame > loadedEnd) {
+      float* dst = pInput->frames + pInput->numLoaded * numChannels;
+      size_t dataEnd = lastFrame < pInput->numFrames ? lastFrame : pInput->numFrames;
+      size_t numData = dataEnd > loadedEnd ? dataEnd - loadedEnd : 0;
+      if(numData > 0) {
+         size_t frameSize = (size_t)pInput->kernels->bytesPerSample * numChannels;
+         size_t stored = pInput->storedReversed ? pInput->numFrames - dataEnd : loadedEnd;
+         pInput->kernels->toFloat(pInput->data + stored * frameSize, dst, numData * numChannels);
+         if(pInput->storedReversed) {
+            SAMPLEKERNELS[kernelLevel][KERNELSF32 + (numChannels < 3 ? numChannels - 1 : 2)]
+               .reverse((unsigned char*)dst, numData, 0, numData / 2, numChannels);
+         }
+      }
+      memset(dst + numData * numChannels, 0, 
+             (lastFrame - loadedEnd - numData) * numChannels * sizeof(float));
+      pInput->numLoaded = lastFrame - pInput->firstFrame;
+   }
+   return pInput->frames + (firstFrame - pInput->firstFrame) * numChannels;
+}
+
+/**
+ * @brief Checks whether the running CPU can execute the kernels built for a feature level.
+ * 
+ * @param level the kernel feature level to be checked
+ * @return true if every instruction set extension the level was compiled for is available.
+ *         false otherwise.
+ */
+bool isaSupported(enum isaLevel level) {
+#ifdef DWAVX86
+   __builtin_cpu_init();
+   switch(level) {
+      case ISAGENERIC:
+         return true;
+      case ISASSE2:
+         return __builtin_cpu_supports("sse2");
+      case ISAAVX2:
+         return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+      case ISAAVX512:
+         return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vl") && __builtin_cpu_supports("avx512dq");
+      default:
+         return false;
+   }
+#else
+   return level == ISAGENERIC;
+#endif
+}
+
+/**
+ * @brief Finds the fastest kernel feature level the running CPU supports.
+ * 
+ * @return enum isaLevel the highest supported level
+ */
+enum isaLevel detectIsaLevel(void) {
+   enum isaLevel level = NUMISALEVELS - 1;
+   while(level > ISAGENERIC && !isaSupported(level)) {
+      --level;
+   }
+   return level;
+}
+
+/**
+ * @brief Forces the kernel feature level to the one named in the command-line argument following
+ *        a -isa flag, for benchmarking one level against another.
+ * 
+ * @param index the index at which the desired level's name resides
+ */
+void setIsaLevel(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No instruction set specified. Please see README for usage.");
+      exit(1);
+   }
+   for(int level = ISAGENERIC; level < NUMISALEVELS; ++level) {
+      if(strcmp(argv[index], ISANAMES[level]) == 0) {
+         if(!isaSupported(level)) {
+            printf("Instruction set %s is not supported by this CPU.", argv[index]);
+            exit(1);
+         }
+         kernelLevel = level;
+         return;
+      }
+   }
+   printf("Invalid instruction set %s. Valid sets are generic, sse2, avx2 and avx512.", 
+          argv[index]);
+   exit(1);
+}
+
+/**
+ * @brief Finds the format tag a file's samples are stored in. An extensible format names it in
+ *        the first two bytes of its subformat GUID, after the valid bits and speaker mask.
+ * 
+ * @param pSoundFile a pointer to the wav struct describing the samples
+ * @return short the audio form, or the subformat's tag for an extensible format that has one
+ */
+short getFormatTag(const struct wav* pSoundFile) {
+   if(pSoundFile->formatElements.audioForm == WAVEFORMATEXTENSIBLE && 
+      pSoundFile->extraParamsSize >= 10) {
+      return (short)(pSoundFile->extraParams[8] | pSoundFile->extraParams[9] << 8);
+   }
+   return pSoundFile->formatElements.audioForm;
+}
+
+/**
+ * @brief Selects the specialized sample kernels for a file, keyed on its format tag, bit depth
+ *        and channel count.
+ * 
+ * @param pSoundFile a pointer to the wav struct describing the samples
+ * @return const struct sampleKernels* the most specialized kernels for the format. Formats dWAV
+ *         cannot decode get the generic kernels, which only support frame reordering.
+ */
+const struct sampleKernels* getSampleKernels(const struct wav* pSoundFile) {
+   const struct fmt* pFormat = &pSoundFile->formatElements;
+   int row = KERNELSBYTES;
+   short formatTag = getFormatTag(pSoundFile);
+   bool isFloat = formatTag == WAVEFORMATIEEEFLOAT;
+   if(isFloat || formatTag == WAVEFORMATPCM) {
+      switch(pFormat->bitsPerSample) {
+         case 8: row = isFloat ? KERNELSBYTES : KERNELSU8; break;
+         case 16: row = isFloat ? KERNELSBYTES : KERNELSS16; break;
+         case 24: row = isFloat ? KERNELSBYTES : KERNELSS24; break;
+         case 32: row = isFloat ? KERNELSF32 : KERNELSS32; break;
+         case 64: row = isFloat ? KERNELSF64 : KERNELSBYTES; break;
+      }
+   }
+   //Typed kernels also require tightly packed frames
+   if(row != KERNELSBYTES && pFormat->blockAlign != 
+      SAMPLEKERNELS[kernelLevel][row].bytesPerSample * pFormat->numChannels) {
+      row = KERNELSBYTES;
+   }
+   if(row != KERNELSBYTES) {
+      if(pFormat->numChannels == 1) {
+         return &SAMPLEKERNELS[kernelLevel][row];
+      }
+      if(pFormat->numChannels == 2) {
+         return &SAMPLEKERNELS[kernelLevel][row + 1];
+      }
+      return &SAMPLEKERNELS[kernelLevel][row + 2];
+   }
+   return &SAMPLEKERNELS[kernelLevel][KERNELSBYTES];
+}
+
+/**
+ * @brief Reverses one worker's share of the mirrored frame pairs of a wav struct's sound data.
+ * 
+ * @param pSoundFile the pointer to the wav struct whose data is being reversed
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers reversing the data
+ */
+void reverseSlice(void* pSoundFile, int worker, int numWorkers) {
+   struct wav* pFile = (struct wav*)pSoundFile;
+   const struct sampleKernels* kernels = getSampleKernels(pFile);
+   int blockSize = pFile->formatElements.blockAlign;
+   //Reverses whole sample blocks; any trailing partial block is left in place
+   size_t numFrames = (size_t)pFile->dataElements.subChunk2Size / blockSize;
+   size_t firstPair, lastPair;
+   getMirroredSlice(numFrames, worker, numWorkers, &firstPair, &lastPair);
+   lastPair = lastPair < numFrames / 2 ? lastPair : numFrames / 2;
+   kernels->reverse(pFile->dataElements.subChunkData, numFrames, firstPair, lastPair,
+                    kernels == &SAMPLEKERNELS[kernelLevel][KERNELSBYTES] ? blockSize : 
+                                                                pFile->formatElements.numChannels);
+}
+
+/**
+ * @brief Reverses the sound data in the passed wav struct
+ * 
+ * @param pSoundFile the pointer to the wav struct whose data is to be reversed
+ */
+void reverseFile(struct wav* pSoundFile) {
+   if(pSoundFile->formatElements.blockAlign <= 0) {
+      printf("Error reversing the file.");
+      exit(1);
+   }
+   parallelFor(fileWorkers, reverseSlice, pSoundFile);
+}
+
+/**
+ * @brief Copies one worker's share of the sample frames from the input mapping into the output
+ *        mapping, reversing them on the way if requested.
+ * 
+ * @param pCopy a pointer to the shared mappedCopy struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the copy
+ */
+void copyFramesSlice(void* pCopy, int worker, int numWorkers) {
+   struct mappedCopy* copy = (struct mappedCopy*)pCopy;
+   size_t firstFrame = copy->numFrames * worker / numWorkers;
+   size_t lastFrame = copy->numFrames * (worker + 1) / numWorkers;
+   if(copy->reversed) {
+      copy->kernels->reverseCopy(copy->dst, copy->src, copy->numFrames, firstFrame, lastFrame, 
+                                 copy->kernelWidth);
+   }
+   else {
+      size_t frameSize = copy->kernels->bytesPerSample ? 
+                         copy->kernels->bytesPerSample * (size_t)copy->kernelWidth : 
+                         (size_t)copy->kernelWidth;
+      memcpy(copy->dst + firstFrame * frameSize, copy->src + firstFrame * frameSize, 
+             (lastFrame - firstFrame) * frameSize);
+   }
+}
+
+/**
+ * @brief Lays out the pieces of the output file for a wav struct, in file order, and sets the
+ *        RIFF chunk size to match.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be written
+ * @param pieces holds the pieces of the output file
+ * @param pLength holds the total length of the output file
+ * @return int the number of pieces
+ */
+int layoutOutputFile(struct wav* pSoundFile, struct outputPiece pieces[], size_t* pLength) {
+   static const unsigned char padding[1] = {0};
+   int numPieces = 0;
+   remapMarkers(pSoundFile);
+   pSoundFile->formatElements.subChunk1Size = FMTSUBCHUNKSIZENOPARAMS + 
+                                              pSoundFile->extraParamsSize;
+   pieces[numPieces++] = (struct outputPiece){ (unsigned char*)&pSoundFile->riffElements, 
+                                               sizeof(struct riff), false };
+   pieces[numPieces++] = (struct outputPiece){ (unsigned char*)&pSoundFile->formatElements, 
+                                               sizeof(struct fmt), false };
+   if(pSoundFile->extraParamsSize > 0) {
+      pieces[numPieces++] = (struct outputPiece){ pSoundFile->extraParams, 
+                                                  pSoundFile->extraParamsSize, false };
+   }
+   for(int i = 0; i <= pSoundFile->numExtraSubChunks; ++i) {
+      if(i == pSoundFile->numSubChunksBeforeData) {
+         //The JUNK subchunk before data holds any reservation, grown until the data payload
+         //starts on a sector boundary. An aligned payload needs no JUNK subchunk at all
+         size_t offset = 0;
+         for(int p = 0; p < numPieces; ++p) {
+            offset += pieces[p].length;
+         }
+         int junkSize = junkReservation < 0 ? -1 : junkReservation + (junkReservation & 1);
+         if(sectorAlignment > 0 && (junkReservation >= 0 || 
+                                    (offset + CHUNKHEADERSIZE) % sectorAlignment != 0)) {
+            junkSize = junkSize > 0 ? junkSize : 0;
+            junkSize += (sectorAlignment - (offset + junkSize + 2 * CHUNKHEADERSIZE) % 
+                                           sectorAlignment) % sectorAlignment;
+         }
+         if(junkSize >= 0) {
+            struct data* pJunk = &pSoundFile->reservedJunk;
+            memcpy(pJunk->subChunk2ID, "JUNK", 4);
+            pJunk->subChunk2Size = junkSize;
+            pieces[numPieces++] = (struct outputPiece){ (unsigned char*)pJunk, CHUNKHEADERSIZE, 
+                                                        false };
+            pieces[numPieces++] = (struct outputPiece){ NULL, pJunk->subChunk2Size, false };
+         }
+         struct data* pData = &pSoundFile->dataElements;
+         pieces[numPieces++] = (struct outputPiece){ (unsigned char*)pData, CHUNKHEADERSIZE, 
+                                                     false };
+         pieces[numPieces++] = (struct outputPiece){ pData->subChunkData, pData->subChunk2Size, 
+                                                     true };
+         if(pData->subChunk2Size & 1) {
+            pieces[numPieces++] = (struct outputPiece){ padding, 1, false };
+         }
+      }
+      if(i == pSoundFile->numExtraSubChunks) {
+         break;
+      }
+      struct data* subChunk = &pSoundFile->extraChunks[i];
+      //A reservation or alignment replaces whatever padding the file already had
+      if((junkReservation >= 0 || sectorAlignment > 0) && isPaddingSubChunk(subChunk)) {
+         continue;
+      }
+      pieces[numPieces++] = (struct outputPiece){ (unsigned char*)subChunk, CHUNKHEADERSIZE, 
+                                                  false };
+      pieces[numPieces++] = (struct outputPiece){ subChunk->subChunkData, 
+                                                  subChunk->subChunk2Size, false };
+      if(subChunk->subChunk2Size & 1) {
+         pieces[numPieces++] = (struct outputPiece){ padding, 1, false };
+      }
+   }
+   *pLength = 0;
+   for(int i = 0; i < numPieces; ++i) {
+      *pLength += pieces[i].length;
+   }
+   pSoundFile->riffElements.chunkSize = (int)(*pLength - CHUNKHEADERSIZE);
+   return numPieces;
+}
+
+/**
+ * @brief Sizes an output file up front, maps it, and writes all of the .wav file data straight
+ *        into the mapping. The sample data goes from the input mapping into the output mapping
+ *        in one pass, reversed on the way if requested, and through any pending stages.
+ * 
+ * @param outputfilename the filename of the desired output file
+ * @param pSoundFile a pointer to the wav struct to be written to the file
+ * @param reversed whether the sample frames are to be written in reverse order
+ * @param pChain a pointer to the stages still to be applied, emptied once they are, or NULL
+ */
+void writeMappedOutputFile(char* outputfilename, struct wav* pSoundFile, bool reversed, 
+                           struct stageChain* pChain) {
+#ifdef _WIN32
+   printf("Mapped mode is not supported on this platform.");
+   exit(1);
+#else
+   struct outputPiece pieces[MAXOUTPUTPIECES];
+   size_t length;
+   int numPieces = layoutOutputFile(pSoundFile, pieces, &length);
+   int outputfilehandle = openOutputFile(outputfilename);
+   fprintf(statusStream(), "Writing to file %s\n", outputfilename);
+   //Reserve the blocks up front where the file system supports it, then size the file. Sparse
+   //files only get the blocks their data needs
+   if(!sparseOutput) {
+      posix_fallocate(outputfilehandle, 0, length);
+   }
+   if(ftruncate(outputfilehandle, length) != 0) {
+      printf("Error sizing output file %s", outputfilename);
+      exit(1);
+   }
+   unsigned char* out = (unsigned char*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, 
+                                             outputfilehandle, 0);
+   if(out == MAP_FAILED) {
+      printf("Error mapping output file %s", outputfilename);
+      exit(1);
+   }
+   size_t offset = 0;
+   for(int i = 0; i < numPieces; ++i) {
+      if(!pieces[i].bytes) {
+         offset += pieces[i].length; //The newly sized file already reads as zeros
+         continue;
+      }
+      if(!pieces[i].isSampleData) {
+         memcpy(out + offset, pieces[i].bytes, pieces[i].length);
+         offset += pieces[i].length;
+         continue;
+      }
+      //The sample frames go straight from the input mapping into the output mapping
+      const struct sampleKernels* kernels = getSampleKernels(pSoundFile);
+      int blockSize = pSoundFile->formatElements.blockAlign > 0 ? 
+                      pSoundFile->formatElements.blockAlign : 1;
+      struct mappedCopy copy = { out + offset, pieces[i].bytes, pieces[i].length / blockSize, 
+                                 kernels, 
+                                 kernels->bytesPerSample ? pSoundFile->formatElements.numChannels : 
+                                                           blockSize, 
+                                 reversed };
+      if(pChain && pChain->numStages > 0) {
+         struct stageSink sink = { out + offset, -1, outputfilename, 0 };
+         streamStages(pSoundFile, pChain->stages, pChain->numStages, reversed, &sink);
+         destroyStages(pChain);
+      }
+      else {
+         parallelFor(fileWorkers, copyFramesSlice, &copy);
+      }
+      //Any trailing partial block is copied as-is
+      size_t tail = copy.numFrames * blockSize;
+      memcpy(out + offset + tail, pieces[i].bytes + tail, pieces[i].length - tail);
+      //Silent pages are dropped before they are ever written back
+      if(sparseOutput) {
+         punchZeroPages(outputfilehandle, out + offset, pieces[i].length, offset);
+      }
+      offset += pieces[i].length;
+   }
+   fprintf(statusStream(), "Bytes Written: %zu\n", length);
+   munmap(out, length);
+   closeOutputFile(outputfilehandle, outputfilename);
+#endif
+}
+
+/**
+ * @brief Opens an output file and writes all of the .wav file data to it. Pending stages stream
+ *        the sample data into its place in the file as they go, so it is never written back to
+ *        memory first.
+ * 
+ * @param outputfilename the filename of the desired output file
+ * @param pSoundFile a pointer to the wav struct to be written to the file
+ * @param pChain a pointer to the stages still to be applied, emptied once they are
+ */
+void writeOutputFile(char* outputfilename, struct wav* pSoundFile, struct stageChain* pChain) {
+#ifdef _WIN32
+   //Without writes by offset the stages are applied in memory first
+   flushStages(pSoundFile, pChain, false);
+#else
+   if(pChain->numStages > 0) {
+      size_t length, dataOffset;
+      int outputfilehandle = createOutputFile(outputfilename, pSoundFile, &dataOffset, &length);
+      struct stageSink sink = { NULL, outputfilehandle, outputfilename, dataOffset };
+      streamStages(pSoundFile, pChain->stages, pChain->numStages, false, &sink);
+      destroyStages(pChain);
+      //Any trailing partial frame is written as-is
+      size_t tail = pSoundFile->frames.numFrames * pSoundFile->formatElements.blockAlign;
+      writeAt(outputfilehandle, outputfilename, pSoundFile->dataElements.subChunkData + tail, 
+              pSoundFile->dataElements.subChunk2Size - tail, dataOffset + tail);
+      fprintf(statusStream(), "Bytes Written: %zu\n", length);
+      closeOutputFile(outputfilehandle, outputfilename);
+      return;
+   }
+#endif
+   int outputfilehandle = openOutputFile(outputfilename);
+   fprintf(statusStream(), "Writing to file %s\n", outputfilename);
+   struct outputPiece pieces[MAXOUTPUTPIECES];
+   size_t length;
+   int numPieces = layoutOutputFile(pSoundFile, pieces, &length);
+   size_t bytesWritten = writePieces(outputfilehandle, outputfilename, pieces, numPieces, -1, NULL);
+   fprintf(statusStream(), "Bytes Written: %zu\n", bytesWritten);
+   closeOutputFile(outputfilehandle, outputfilename);
+}
+
+/**
+ * @brief Writes every piece of an output file in file order. Large writes can come back short, so
+ *        each piece is written until done. Given the input file, the sample data is copied from it
+ *        to the output file inside the kernel, which file systems that share blocks between files
+ *        can do without copying at all. With -sparse, silent runs of the sample data are seeked
+ *        over instead of written.
+ * 
+ * @param outputfilehandle the handle of the output file, positioned where the pieces start
+ * @param outputfilename the filename of the output file, for error messages
+ * @param pieces the pieces of the output file
+ * @param numPieces the number of pieces
+ * @param inputfilehandle the handle of the unaltered input file, or -1 to write from memory
+ * @param fileBytes the memory holding the input file, which the sample data points into
+ * @return size_t the number of bytes written
+ */
+size_t writePieces(int outputfilehandle, char* outputfilename, const struct outputPiece pieces[], 
+                   int numPieces, int inputfilehandle, const unsigned char* fileBytes) {
+   static const unsigned char zeros[POOLPAGESIZE] = {0};
+   size_t bytesWritten = 0;
+   size_t position = sparseOutput ? (size_t)lseek(outputfilehandle, 0, SEEK_CUR) : 0;
+   bool endsInHole = false;
+   for(int i = 0; i < numPieces; ++i) {
+      for(size_t offset = 0; offset < pieces[i].length; ) {
+         size_t remaining = pieces[i].length - offset;
+         long chunkWritten = -1;
+         if(sparseOutput && pieces[i].isSampleData && pieces[i].bytes) {
+            size_t start = offset;
+            size_t run = findZeroPages(pieces[i].bytes, pieces[i].length, position - offset, 
+                                       &start);
+            if(start == offset && run > 0) {
+               lseek(outputfilehandle, (off_t)run, SEEK_CUR);
+               offset += run;
+               position += run;
+               bytesWritten += run;
+               endsInHole = true;
+               continue;
+            }
+            remaining = start - offset;
+         }
+#ifdef __linux__
+         if(pieces[i].isSampleData && inputfilehandle >= 0) {
+            loff_t inputOffset = (loff_t)(pieces[i].bytes - fileBytes + offset);
+            chunkWritten = copy_file_range(inputfilehandle, &inputOffset, outputfilehandle, NULL, 
+                                           remaining, 0);
+            if(chunkWritten < 0) {
+               inputfilehandle = -1; //Not possible between these files, so write from memory
+            }
+         }
+#endif
+         if(chunkWritten < 0) {
+            chunkWritten = pieces[i].bytes ? 
+               write(outputfilehandle, pieces[i].bytes + offset, remaining) : 
+               write(outputfilehandle, zeros, remaining < sizeof(zeros) ? remaining : sizeof(zeros));
+         }
+         if(chunkWritten <= 0) {
+            printf("Error writing to output file %s", outputfilename);
+            exit(1);
+         }
+         offset += chunkWritten;
+         position += chunkWritten;
+         bytesWritten += chunkWritten;
+         endsInHole = false;
+      }
+   }
+   //A hole at the very end needs the file sized past it
+   if(endsInHole && ftruncate(outputfilehandle, (off_t)position) != 0) {
+      printf("Error sizing output file %s", outputfilename);
+      exit(1);
+   }
+   return bytesWritten;
+}
+
+/**
+ * @brief Creates an output file and writes everything but its sample data, leaving room for the
+ *        data to be written at its offset, by several workers at once if need be.
+ * 
+ * @param outputfilename the filename of the desired output file
+ * @param pSoundFile a pointer to the wav struct describing the file, with its data size set
+ * @param pDataOffset holds the offset of the sample data in the file
+ * @param pLength holds the total length of the file
+ * @return int the handle of the output file, open for writing
+ */
+int createOutputFile(char* outputfilename, struct wav* pSoundFile, size_t* pDataOffset, 
+                     size_t* pLength) {
+#ifdef _WIN32
+   printf("Writing sample data by offset is not supported on this platform.");
+   exit(1);
+#else
+   struct outputPiece pieces[MAXOUTPUTPIECES];
+   int numPieces = layoutOutputFile(pSoundFile, pieces, pLength);
+   int dataPiece = 0;
+   *pDataOffset = 0;
+   while(!pieces[dataPiece].isSampleData) {
+      *pDataOffset += pieces[dataPiece++].length;
+   }
+   int outputfilehandle = openOutputFile(outputfilename);
+   fprintf(statusStream(), "Writing to file %s\n", outputfilename);
+   writePieces(outputfilehandle, outputfilename, pieces, dataPiece, -1, NULL);
+   lseek(outputfilehandle, (off_t)(*pDataOffset + pieces[dataPiece].length), SEEK_SET);
+   writePieces(outputfilehandle, outputfilename, pieces + dataPiece + 1, 
+               numPieces - dataPiece - 1, -1, NULL);
+   //Sized up front, so silent runs never written still read as zeros
+   if(sparseOutput && ftruncate(outputfilehandle, (off_t)*pLength) != 0) {
+      printf("Error sizing output file %s", outputfilename);
+      exit(1);
+   }
+   return outputfilehandle;
+#endif
+}
+
+/**
+ * @brief Writes bytes at an offset in an output file without moving its file position, so
+ *        several workers can fill one file at once. Large writes can come back short, so the
+ *        bytes are written until done. With -sparse, silent runs are skipped and left as holes.
+ * 
+ * @param outputfilehandle the handle of the output file
+ * @param outputfilename the filename of the output file, for error messages
+ * @param bytes the bytes to be written
+ * @param length the number of bytes to be written
+ * @param offset the offset in the file the bytes are written at
+ */
+void writeAt(int outputfilehandle, char* outputfilename, const unsigned char* bytes, size_t length, 
+             size_t offset) {
+#ifndef _WIN32
+   for(size_t written = 0, end = length; written < length; ) {
+      if(sparseOutput) {
+         size_t start = written;
+         size_t run = findZeroPages(bytes, length, offset, &start);
+         if(start == written && run > 0) {
+            written += run;
+            continue;
+         }
+         end = start;
+      }
+      ssize_t chunkWritten = pwrite(outputfilehandle, bytes + written, end - written, 
+                                    (off_t)(offset + written));
+      if(chunkWritten <= 0) {
+         printf("Error writing to output file %s", outputfilename);
+         exit(1);
+      }
+      written += chunkWritten;
+   }
+#endif
+}
+
+/**
+ * @brief Orders two frame positions for qsort.
+ * 
+ * @param pFirst a pointer to the first frame position
+ * @param pSecond a pointer to the second frame position
+ * @return int negative, zero or positive as the first position is before, at or after the second
+ */
+int compareFrames(const void* pFirst, const void* pSecond) {
+   size_t first = *(const size_t*)pFirst, second = *(const size_t*)pSecond;
+   return (first > second) - (first < second);
+}
+
+/**
+ * @brief Cuts the sound data of a wav struct at every cue point and writes each segment to its
+ *        own numbered file, "<output name>_<n>.wav". Every segment keeps the file's other
+ *        subchunks, with its markers remapped to its own frames. Segments that are not reversed
+ *        are written concurrently, straight from the input file when their samples are unaltered;
+ *        reversed ones are written one at a time, each copied into its output mapping by all of
+ *        the workers.
+ * 
+ * @param inputfilename the name of the input file the segments are copied from
+ * @param outputfilename the filename the segment filenames are built from
+ * @param pSoundFile a pointer to the wav struct to be split
+ * @param reversed whether the sample frames are to be written in reverse order
+ */
+void writeSegments(char* inputfilename, char* outputfilename, struct wav* pSoundFile, 
+                   bool reversed) {
+   //Segment boundaries are the cue points' positions in the data as it will be written
+   struct data* pCue = findSubChunk(pSoundFile, "cue ", NULL);
+   int numCues = 0;
+   if(pCue && pCue->subChunk2Size >= 4) {
+      memcpy(&numCues, pCue->subChunkData, sizeof(numCues));
+      int maxCues = (pCue->subChunk2Size - 4) / CUEPOINTSIZE;
+      numCues = numCues < 0 ? 0 : numCues < maxCues ? numCues : maxCues;
+   }
+   size_t* boundaries = (size_t*)malloc((numCues + 2) * sizeof(size_t));
+   if(!boundaries) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   size_t numFrames = pSoundFile->frames.numFrames;
+   int numBoundaries = 0;
+   boundaries[numBoundaries++] = 0;
+   for(int i = 0; i < numCues; ++i) {
+      uint32_t sampleOffset;
+      memcpy(&sampleOffset, pCue->subChunkData + 4 + (size_t)i * CUEPOINTSIZE + 20, 
+             sizeof(sampleOffset));
+      size_t start = sampleOffset, end = sampleOffset;
+      if(mapFrameRange(&pSoundFile->frames, &start, &end) && start > 0 && start < numFrames) {
+         boundaries[numBoundaries++] = start;
+      }
+   }
+   qsort(boundaries, numBoundaries, sizeof(size_t), compareFrames);
+   int numUnique = 1;
+   for(int i = 1; i < numBoundaries; ++i) {
+      if(boundaries[i] != boundaries[numUnique - 1]) {
+         boundaries[numUnique++] = boundaries[i];
+      }
+   }
+   boundaries[numUnique] = numFrames;
+
+   struct split split = { outputfilename, pSoundFile, boundaries, numUnique, 0, -1, reversed, 
+                          PTHREAD_MUTEX_INITIALIZER };
+   if(!reversed && !pSoundFile->samplesAltered) {
+      split.inputfilehandle = open(inputfilename, O_RDONLY | O_BINARY);
+   }
+   fprintf(statusStream(), "Splitting into %d segments\n", numUnique);
+   parallelFor(reversed ? 1 : fileWorkers, writeSegmentsSlice, &split);
+   if(split.inputfilehandle >= 0) {
+      close(split.inputfilehandle);
+   }
+   free(boundaries);
+}
+
+/**
+ * @brief Claims segments of a split one at a time and writes each to its own file.
+ * 
+ * @param pSplit a pointer to the shared split struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers writing segments
+ */
+void writeSegmentsSlice(void* pSplit, int worker, int numWorkers) {
+   struct split* split = (struct split*)pSplit;
+   int stemLength = (int)(strlen(split->outputfilename) - strlen(VALIDEXTENSION));
+   int digits = snprintf(NULL, 0, "%d", split->numSegments);
+   while(true) {
+      pthread_mutex_lock(&split->lock);
+      int index = split->nextSegment++;
+      pthread_mutex_unlock(&split->lock);
+      if(index >= split->numSegments) {
+         return;
+      }
+      char* filename = (char*)malloc(stemLength + digits + sizeof("_" VALIDEXTENSION));
+      if(!filename) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+      sprintf(filename, SEGMENTFILENAME, stemLength, split->outputfilename, digits, index + 1);
+      //Each segment is the whole file trimmed to its frames, sharing everything else
+      struct wav segment = *split->pSoundFile;
+      segment.remappedMarkers = NULL;
+      trimFile(&segment, split->boundaries[index], split->boundaries[index + 1], split->reversed);
+      //A cue on the boundary starts the next segment rather than ending this one
+      segment.frames.endShared = index < split->numSegments - 1;
+      if(split->reversed) {
+         writeMappedOutputFile(filename, &segment, true, NULL);
+      }
+      else {
+         int outputfilehandle = openOutputFile(filename);
+         struct outputPiece pieces[MAXOUTPUTPIECES];
+         size_t length;
+         int numPieces = layoutOutputFile(&segment, pieces, &length);
+         size_t bytesWritten = writePieces(outputfilehandle, filename, pieces, numPieces, 
+                                           split->inputfilehandle, segment.fileBytes);
+         fprintf(statusStream(), "Wrote %zu bytes to file %s\n", bytesWritten, filename);
+         closeOutputFile(outputfilehandle, filename);
+      }
+      free(segment.remappedMarkers);
+      free(filename);
+   }
+}
+
+/**
+ * @brief Determines whether a flag adds a stage to the streaming pass.
+ * 
+ * @param flag the flag to be checked
+ * @return true if the flag is a stage flag.
+ *         false otherwise.
+ */
+bool isStageFlag(int flag) {
+   return flag == FLAGHIGHPASS || flag == FLAGLOWPASS || flag == FLAGLOWSHELF || 
+          flag == FLAGHIGHSHELF || flag == FLAGCONVOLVE || flag == FLAGLIMIT || 
+          flag == FLAGCOMPRESS || flag == FLAGGAIN;
+}
+
+/**
+ * @brief Checks to make sure there are valid filter settings in the command-line arguments
+ *        following a filter flag: a positive frequency in Hz and, for shelves, a gain in dB.
+ * 
+ * @param index the index at which the frequency resides
+ * @param numValues the number of settings the filter takes
+ */
+void validateFilter(size_t index, int argc, char* argv[], int numValues) {
+   if(index + numValues > argc) {
+      printf("No filter settings specified. Please see README for usage.");
+      exit(1);
+   }
+   for(int i = 0; i < numValues; ++i) {
+      char* end;
+      double value = strtod(argv[index + i], &end);
+      if(end == argv[index + i] || *end != '\0' || !isfinite(value) || (i == 0 && value <= 0)) {
+         printf("Invalid filter setting %s. Frequencies must be positive and gains numbers.", 
+                argv[index + i]);
+         exit(1);
+      }
+   }
+}
+
+/**
+ * @brief Checks to make sure there is a valid gain in dB in the command-line argument following a
+ *        -gain flag.
+ * 
+ * @param index the index at which the gain resides
+ */
+void validateGain(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No gain specified. Please see README for usage.");
+      exit(1);
+   }
+   char* end;
+   double gain = strtod(argv[index], &end);
+   if(end == argv[index] || *end != '\0' || !isfinite(gain)) {
+      printf("Invalid gain %s. Gains must be numbers in dB.", argv[index]);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Computes the coefficients of a biquad section from the Audio EQ Cookbook. Passes are
+ *        Butterworth (a Q of 1/sqrt(2)) and shelves have a slope of 1.
+ * 
+ * @param flag the filter flag: high-pass, low-pass, low shelf or high shelf
+ * @param frequency the cutoff or shelf midpoint frequency in Hz
+ * @param gain the shelf gain in dB, unused by passes
+ * @param sampleRate the sample rate of the file being filtered
+ * @param pSection holds the normalized coefficients
+ */
+void designBiquad(int flag, double frequency, double gain, int sampleRate, 
+                  struct biquad* pSection) {
+   const double pi = 3.14159265358979323846;
+   double w0 = 2 * pi * frequency / sampleRate, cosW0 = cos(w0), sinW0 = sin(w0);
+   double b0, b1, b2, a0, a1, a2;
+   if(flag == FLAGHIGHPASS || flag == FLAGLOWPASS) {
+      double alpha = sinW0 / sqrt(2.0);
+      double sign = flag == FLAGLOWPASS ? 1 : -1;
+      b0 = b2 = (1 - sign * cosW0) / 2;
+      b1 = sign * (1 - sign * cosW0);
+      a0 = 1 + alpha;
+      a1 = -2 * cosW0;
+      a2 = 1 - alpha;
+   }
+   else {
+      //The high shelf is the low shelf with the sign of every (A - 1) and cos(w0) term flipped
+      double A = pow(10, gain / 40), root = 2 * sqrt(A) * sinW0 / sqrt(2.0);
+      double sign = flag == FLAGLOWSHELF ? 1 : -1;
+      b0 = A * ((A + 1) - sign * (A - 1) * cosW0 + root);
+      b1 = sign * 2 * A * ((A - 1) - sign * (A + 1) * cosW0);
+      b2 = A * ((A + 1) - sign * (A - 1) * cosW0 - root);
+      a0 = (A + 1) + sign * (A - 1) * cosW0 + root;
+      a1 = -sign * 2 * ((A - 1) + sign * (A + 1) * cosW0);
+      a2 = (A + 1) + sign * (A - 1) * cosW0 - root;
+   }
+   *pSection = (struct biquad){ (float)(b0 / a0), (float)(b1 / a0), (float)(b2 / a0), 
+                                (float)(a1 / a0), (float)(a2 / a0) };
+}
+
+/**
+ * @brief Stage body of a biquad section.
+ * 
+ * @param pStage a pointer to the biquad stage
+ * @param samples the block of interleaved float frames, filtered in place
+ * @param numFrames the number of frames in the block
+ * @param numChannels the number of channels per frame
+ */
+void processBiquad(struct stage* pStage, float* samples, size_t numFrames, int numChannels) {
+   FLOATKERNELS[kernelLevel].biquad[numChannels < 3 ? numChannels : 0](samples, numFrames, 
+                                                                      numChannels, 
+                                                                      &pStage->section, 
+                                                                      pStage->state);
+}
+
+/**
+ * @brief Stage body of a gain change.
+ * 
+ * @param pStage a pointer to the gain stage
+ * @param samples the block of interleaved float frames, scaled in place
+ * @param numFrames the number of frames in the block
+ * @param numChannels the number of channels per frame
+ */
+void processGain(struct stage* pStage, float* samples, size_t numFrames, int numChannels) {
+   float gain = pStage->gain;
+   for(size_t i = 0; i < numFrames * numChannels; ++i) {
+      samples[i] *= gain;
+   }
+}
+
+/**
+ * @brief Builds a stage for every stage flag in the run starting at index and adds them to the
+ *        chain of pending stages. Nothing is applied until the chain is streamed.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose data is to be transformed
+ * @param index the index of the first stage flag of the run
+ * @param pChain a pointer to the chain the stages are added to
+ * @return size_t the index of the last argument of the run
+ */
+size_t addStages(struct wav* pSoundFile, size_t index, int argc, char* argv[], 
+                 struct stageChain* pChain) {
+   if(!getSampleKernels(pSoundFile)->toFloat) {
+      printf("Streaming transforms are not supported for this sample format.");
+      exit(1);
+   }
+   struct stage* stages = pChain->stages;
+   int sampleRate = pSoundFile->formatElements.sampleRate;
+   int numChannels = pSoundFile->formatElements.numChannels > 0 ? 
+                     pSoundFile->formatElements.numChannels : 1;
+   for(; index < argc && isValidFlag(argv[index]) && isStageFlag(getFlag(argv[index])); ++index) {
+      if(pChain->numStages == MAXSTAGES) {
+         printf("dWAV can chain at most %d stages in one pass.", MAXSTAGES);
+         exit(1);
+      }
+      int flag = getFlag(argv[index]);
+      struct stage* pStage = &stages[pChain->numStages++];
+      *pStage = (struct stage){ .process = NULL };
+      if(flag == FLAGGAIN) {
+         pStage->process = processGain;
+         pStage->gain = (float)pow(10, strtod(argv[++index], NULL) / 20);
+         continue;
+      }
+      if(flag == FLAGCONVOLVE) {
+         pStage->process = processConvolver;
+         pStage->convolver = createConvolver(argv[++index], &pSoundFile->formatElements);
+         pStage->blockFrames = pStage->convolver->partitionFrames;
+         continue;
+      }
+      if(flag == FLAGLIMIT || flag == FLAGCOMPRESS) {
+         double levelDb = strtod(argv[++index], NULL);
+         double ratio = flag == FLAGCOMPRESS ? strtod(argv[++index], NULL) : 0;
+         pStage->process = processDynamics;
+         pStage->dynamics = createDynamics(flag == FLAGLIMIT, levelDb, ratio, pSoundFile);
+         pStage->latency = pStage->dynamics->lookahead;
+         continue;
+      }
+      double frequency = strtod(argv[++index], NULL);
+      double gain = flag == FLAGLOWSHELF || flag == FLAGHIGHSHELF ? strtod(argv[++index], NULL) : 0;
+      if(frequency >= sampleRate / 2.0) {
+         printf("Filter frequency %g Hz is not below the Nyquist frequency of %g Hz.", frequency, 
+                sampleRate / 2.0);
+         exit(1);
+      }
+      pStage->process = processBiquad;
+      designBiquad(flag, frequency, gain, sampleRate, &pStage->section);
+      pStage->state = (float*)calloc(2 * (size_t)numChannels, sizeof(float));
+      if(!pStage->state) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+   }
+   return index - 1;
+}
+
+/**
+ * @brief Applies any pending stages to the sound data in memory, for operations that need their
+ *        result before the output is written, and empties the chain.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose data is to be transformed
+ * @param pChain a pointer to the chain of pending stages
+ * @param storedReversed whether the frames in memory are in the reverse of their current order
+ */
+void flushStages(struct wav* pSoundFile, struct stageChain* pChain, bool storedReversed) {
+   if(pChain->numStages > 0) {
+      streamStages(pSoundFile, pChain->stages, pChain->numStages, storedReversed, NULL);
+      destroyStages(pChain);
+   }
+}
+
+/**
+ * @brief Frees every stage of a chain and empties it.
+ * 
+ * @param pChain a pointer to the chain to be emptied
+ */
+void destroyStages(struct stageChain* pChain) {
+   for(int i = 0; i < pChain->numStages; ++i) {
+      free(pChain->stages[i].state);
+      if(pChain->stages[i].convolver) {
+         destroyConvolver(pChain->stages[i].convolver);
+      }
+      if(pChain->stages[i].dynamics) {
+         destroyDynamics(pChain->stages[i].dynamics);
+      }
+   }
+   pChain->numStages = 0;
+}
+
+/**
+ * @brief Streams the sound data through a chain of stages, in place or into a sink. Each block of
+ *        frames is converted to float once, passed through every stage, and converted back, so
+ *        the whole chain costs one pass over the data. Blocks are as large as the largest block
+ *        any stage works in. The output of stages with latency is written back that many frames
+ *        earlier, and silence is fed in after the last frame to flush them.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose data is to be transformed
+ * @param stages the chain of stages, in order
+ * @param numStages the number of stages
+ * @param storedReversed whether the frames in memory are in the reverse of their current order, 
+ *        in which case they are streamed from the end so the stages see them in order
+ * @param pSink a pointer to where the frames go in playing order, or NULL to write them back in
+ *        place in the order they are stored
+ */
+void streamStages(struct wav* pSoundFile, struct stage stages[], int numStages, 
+                  bool storedReversed, const struct stageSink* pSink) {
+   const struct sampleKernels* kernels = getSampleKernels(pSoundFile);
+   int numChannels = pSoundFile->formatElements.numChannels;
+   //Reversed blocks are put in playing order with the float frame reversal kernel
+   const struct sampleKernels* floatFrames =
+      &SAMPLEKERNELS[kernelLevel][KERNELSF32 + (numChannels < 3 ? numChannels - 1 : 2)];
+   size_t frameSize = (size_t)kernels->bytesPerSample * numChannels;
+   size_t numFrames = pSoundFile->frames.numFrames;
+   size_t maxBlockFrames = STAGEBLOCKFRAMES, latency = 0;
+   for(int s = 0; s < numStages; ++s) {
+      maxBlockFrames = stages[s].blockFrames > maxBlockFrames ? stages[s].blockFrames : 
+                                                                maxBlockFrames;
+      latency += stages[s].latency;
+   }
+   float* block = (float*)malloc(maxBlockFrames * numChannels * sizeof(float));
+   //Frames bound for a file are gathered in a buffer of their own and written in runs of at
+   //least STAGEWRITEBYTES, long enough for -sparse to find silent runs to leave as holes
+   size_t pendingBytes = 0, pendingOffset = 0;
+   unsigned char* bytes = pSink && !pSink->memory ? 
+                          (unsigned char*)malloc(maxBlockFrames * frameSize + STAGEWRITEBYTES) : 
+                          NULL;
+   if(!block || (pSink && !pSink->memory && !bytes)) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   unsigned char* samples = pSoundFile->dataElements.subChunkData;
+   for(size_t done = 0; done < numFrames + latency; ) {
+      size_t blockFrames = numFrames + latency - done < maxBlockFrames ? 
+                           numFrames + latency - done : maxBlockFrames;
+      size_t inFrames = done >= numFrames ? 0 : 
+                        numFrames - done < blockFrames ? numFrames - done : blockFrames;
+      if(inFrames > 0) {
+         size_t first = storedReversed ? numFrames - done - inFrames : done;
+         kernels->toFloat(samples + first * frameSize, block, inFrames * numChannels);
+      }
+      if(storedReversed) {
+         floatFrames->reverse((unsigned char*)block, inFrames, 0, inFrames / 2, numChannels);
+      }
+      memset(block + inFrames * numChannels, 0, 
+             (blockFrames - inFrames) * numChannels * sizeof(float));
+      for(int s = 0; s < numStages; ++s) {
+         stages[s].process(&stages[s], block, blockFrames, numChannels);
+      }
+      //The frames coming out belong latency frames back, all of them already read
+      size_t skipped = done < latency ? (latency - done < blockFrames ? latency - done : 
+                                                                       blockFrames) : 0;
+      size_t outFrames = blockFrames - skipped;
+      size_t outFirst = done + skipped - latency;
+      float* out = block + skipped * numChannels;
+      if(!pSink) {
+         if(storedReversed) {
+            floatFrames->reverse((unsigned char*)out, outFrames, 0, outFrames / 2, numChannels);
+            outFirst = numFrames - outFirst - outFrames;
+         }
+         kernels->fromFloat(out, samples + outFirst * frameSize, outFrames * numChannels);
+      }
+      else if(pSink->memory) {
+         kernels->fromFloat(out, pSink->memory + outFirst * frameSize, outFrames * numChannels);
+      }
+      else {
+         if(pendingBytes == 0) {
+            pendingOffset = pSink->offset + outFirst * frameSize;
+         }
+         kernels->fromFloat(out, bytes + pendingBytes, outFrames * numChannels);
+         pendingBytes += outFrames * frameSize;
+      }
+      done += blockFrames;
+      if(pendingBytes >= STAGEWRITEBYTES || (pendingBytes > 0 && done >= numFrames + latency)) {
+         writeAt(pSink->filehandle, pSink->filename, bytes, pendingBytes, pendingOffset);
+         pendingBytes = 0;
+      }
+   }
+   free(block);
+   free(bytes);
+   pSoundFile->samplesAltered = pSoundFile->samplesAltered || !pSink;
+}
+
+/**
+ * @brief Checks to make sure there are valid dynamics settings in the command-line arguments
+ *        following a -limit or -comp flag: a level in dB at or below full scale and, for the
+ *        compressor, a ratio of at least 1.
+ * 
+ * @param index the index at which the level resides
+ * @param numValues the number of settings the stage takes
+ */
+void validateDynamics(size_t index, int argc, char* argv[], int numValues) {
+   if(index + numValues > argc) {
+      printf("No dynamics settings specified. Please see README for usage.");
+      exit(1);
+   }
+   for(int i = 0; i < numValues; ++i) {
+      char* end;
+      double value = strtod(argv[index + i], &end);
+      if(end == argv[index + i] || *end != '\0' || !isfinite(value) || 
+         (i == 0 && (value > 0 || value < MINDYNAMICSDB)) || (i == 1 && value < 1)) {
+         printf("Invalid dynamics setting %s. Levels must be between %d and 0 dB and ratios at "
+                "least 1.", argv[index + i], MINDYNAMICSDB);
+         exit(1);
+      }
+   }
+}
+
+/**
+ * @brief Prepares a limiter or compressor for a file: its gain curve and time constants, its
+ *        lookahead buffer, and the smoothing state of each detector.
+ * 
+ * @param limiter whether to build a brickwall limiter rather than a compressor
+ * @param levelDb the limiter's ceiling or the compressor's threshold, in dB
+ * @param ratio the compressor's ratio, unused by the limiter
+ * @param pSoundFile a pointer to the wav struct of the file to be processed
+ * @return struct dynamics* a pointer to the new limiter or compressor
+ */
+struct dynamics* createDynamics(bool limiter, double levelDb, double ratio, 
+                                const struct wav* pSoundFile) {
+   const struct fmt* pFormat = &pSoundFile->formatElements;
+   struct dynamics* pDynamics = (struct dynamics*)calloc(1, sizeof(struct dynamics));
+   if(!pDynamics) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   int numChannels = pFormat->numChannels > 0 ? pFormat->numChannels : 1;
+   double rate = pFormat->sampleRate > 0 ? pFormat->sampleRate : 1;
+   size_t lookahead = (size_t)(DYNAMICSLOOKAHEADMS * rate / 1000);
+   pDynamics->limiter = limiter;
+   pDynamics->numDetectors = unlinkedDetection ? numChannels : 1;
+   pDynamics->lookahead = lookahead;
+   pDynamics->threshold = (float)pow(10, levelDb / 20);
+   //Integer samples are rounded to the nearest code, so the ceiling is lowered onto a code that
+   //rounding cannot take them past
+   int bytesPerSample = getSampleKernels(pSoundFile)->bytesPerSample;
+   if(limiter && isIntegerFormat(pSoundFile) && bytesPerSample > 0 && bytesPerSample <= 4) {
+      float fullScale = ldexpf(1, 8 * bytesPerSample - 1);
+      pDynamics->threshold = floorf(pDynamics->threshold * fullScale) / fullScale;
+   }
+   pDynamics->slope = limiter ? -1 : (float)(1 / ratio - 1);
+   pDynamics->attack = (float)(1 - exp(-1000 / (COMPRESSORATTACKMS * rate)));
+   pDynamics->release = (float)(1 - exp(-1000 / ((limiter ? LIMITERRELEASEMS : 
+                                                           COMPRESSORRELEASEMS) * rate)));
+   size_t numLevels = STAGEBLOCKFRAMES * (size_t)numChannels;
+   pDynamics->levels = (float*)malloc(numLevels * sizeof(float));
+   pDynamics->gains = (float*)malloc(numLevels * sizeof(float));
+   pDynamics->pending = (float*)calloc((lookahead + STAGEBLOCKFRAMES) * numChannels, 
+                                       sizeof(float));
+   pDynamics->detectors = (struct dynamicsDetector*)calloc(pDynamics->numDetectors, 
+                                                           sizeof(struct dynamicsDetector));
+   if(!pDynamics->levels || !pDynamics->gains || !pDynamics->pending || !pDynamics->detectors) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   //The detection window covers the lookahead and the frame entering it
+   size_t window = lookahead + 1;
+   for(int d = 0; d < pDynamics->numDetectors; ++d) {
+      struct dynamicsDetector* pDetector = &pDynamics->detectors[d];
+      pDetector->envelope = 1;
+      pDetector->minGains = (float*)malloc(window * sizeof(float));
+      pDetector->minFrames = (size_t*)malloc(window * sizeof(size_t));
+      pDetector->recent = (float*)malloc(window * sizeof(float));
+      if(!pDetector->minGains || !pDetector->minFrames || !pDetector->recent) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+      for(size_t i = 0; i < window; ++i) {
+         pDetector->recent[i] = 1;
+      }
+      pDetector->recentSum = (double)window;
+   }
+   return pDynamics;
+}
+
+/**
+ * @brief Frees a limiter or compressor and everything it holds.
+ * 
+ * @param pDynamics a pointer to the limiter or compressor to be freed
+ */
+void destroyDynamics(struct dynamics* pDynamics) {
+   for(int d = 0; d < pDynamics->numDetectors; ++d) {
+      free(pDynamics->detectors[d].minGains);
+      free(pDynamics->detectors[d].minFrames);
+      free(pDynamics->detectors[d].recent);
+   }
+   free(pDynamics->detectors);
+   free(pDynamics->levels);
+   free(pDynamics->gains);
+   free(pDynamics->pending);
+   free(pDynamics);
+}
+
+/**
+ * @brief Stage body of a limiter or compressor. The levels and the gains they call for are
+ *        computed for a whole block at once with the float kernels, each detector smooths its
+ *        gains frame by frame, and the gains are applied to the frames coming out of the
+ *        lookahead buffer, so every gain change starts before the peak that causes it.
+ * 
+ * @param pStage a pointer to the dynamics stage
+ * @param samples the block of interleaved float frames, processed in place
+ * @param numFrames the number of frames in the block
+ * @param numChannels the number of channels per frame
+ */
+void processDynamics(struct stage* pStage, float* samples, size_t numFrames, int numChannels) {
+   struct dynamics* pDynamics = pStage->dynamics;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   int numDetectors = pDynamics->numDetectors;
+   size_t lookahead = pDynamics->lookahead, window = lookahead + 1;
+   for(size_t done = 0; done < numFrames; ) {
+      size_t blockFrames = numFrames - done < STAGEBLOCKFRAMES ? numFrames - done : 
+                                                                  STAGEBLOCKFRAMES;
+      float* block = samples + done * numChannels;
+      //Unlinked detectors see each sample as a frame of its own
+      size_t numLevels = blockFrames * numDetectors;
+      if(numDetectors == 1) {
+         floatKernels->peaks(block, blockFrames, numChannels, pDynamics->levels);
+      }
+      else {
+         floatKernels->peaks(block, numLevels, 1, pDynamics->levels);
+      }
+      floatKernels->dynamicsGain(pDynamics->levels, pDynamics->gains, numLevels, 
+                                 pDynamics->threshold, pDynamics->slope);
+
+      for(int d = 0; d < numDetectors; ++d) {
+         struct dynamicsDetector* pDetector = &pDynamics->detectors[d];
+         float* gains = pDynamics->gains + d;
+         for(size_t i = 0; i < blockFrames; ++i) {
+            float target = gains[i * numDetectors];
+            //The smallest gain called for within the window, kept in a ring of increasing gains.
+            //It holds through the troughs of a waveform, so a steady tone gets a steady gain
+            size_t frame = pDynamics->numFrames + i;
+            //Ring positions wrap with a compare rather than a division, which is far slower
+            if(pDetector->minCount > 0 && 
+               pDetector->minFrames[pDetector->minFirst] + window <= frame) {
+               pDetector->minFirst = pDetector->minFirst + 1 < window ? pDetector->minFirst + 1 : 0;
+               --pDetector->minCount;
+            }
+            size_t back = pDetector->minFirst + pDetector->minCount;
+            back = back < window ? back : back - window;
+            while(pDetector->minCount > 0) {
+               size_t last = back > 0 ? back - 1 : window - 1;
+               if(pDetector->minGains[last] < target) {
+                  break;
+               }
+               back = last;
+               --pDetector->minCount;
+            }
+            ++pDetector->minCount;
+            pDetector->minGains[back] = target;
+            pDetector->minFrames[back] = frame;
+            float least = pDetector->minGains[pDetector->minFirst];
+            if(!pDynamics->limiter) {
+               float coefficient = least < pDetector->envelope ? pDynamics->attack : 
+                                                                 pDynamics->release;
+               pDetector->envelope += (least - pDetector->envelope) * coefficient;
+               gains[i * numDetectors] = pDetector->envelope;
+               continue;
+            }
+            //Falls at once and recovers over the release time, then is averaged over the window
+            //so it ramps down across the lookahead and reaches the window's least gain in time
+            pDetector->envelope = least < pDetector->envelope ? least : 
+               pDetector->envelope + (least - pDetector->envelope) * pDynamics->release;
+            pDetector->recentSum += pDetector->envelope - pDetector->recent[pDetector->recentNext];
+            pDetector->recent[pDetector->recentNext] = pDetector->envelope;
+            pDetector->recentNext = pDetector->recentNext + 1 < window ? 
+                                    pDetector->recentNext + 1 : 0;
+            gains[i * numDetectors] = (float)(pDetector->recentSum / window);
+         }
+      }
+
+      //The block enters the lookahead buffer and the frames it pushes out get the gains
+      float* pending = pDynamics->pending;
+      memcpy(pending + lookahead * numChannels, block, blockFrames * numChannels * sizeof(float));
+      memcpy(block, pending, blockFrames * numChannels * sizeof(float));
+      memmove(pending, pending + blockFrames * numChannels, 
+              lookahead * numChannels * sizeof(float));
+      if(numDetectors == 1) {
+         floatKernels->applyGains(block, pDynamics->gains, blockFrames, numChannels);
+      }
+      else {
+         floatKernels->applyGains(block, pDynamics->gains, numLevels, 1);
+      }
+      pDynamics->numFrames += blockFrames;
+      done += blockFrames;
+   }
+}
+
+/**
+ * @brief Loads an impulse response and prepares a convolver for it: the FFT tables, the
+ *        spectrum of every partition of every channel of the response, and the delay lines of
+ *        the file's channels. A mono response is applied to every channel; otherwise the
+ *        response must have one channel per channel of the file.
+ * 
+ * @param irfilename the name of the .wav file holding the impulse response
+ * @param pFormat a pointer to the format of the file to be convolved
+ * @return struct convolver* a pointer to the new convolver
+ */
+struct convolver* createConvolver(char* irfilename, const struct fmt* pFormat) {
+   struct bufferPool pool = { .numBuffers = 0 };
+   struct wav ir;
+   size_t length;
+   char* irMem = getMemory(irfilename, &pool, &length);
+   parseWavFile(irfilename, (unsigned char*)irMem, length, &ir);
+   const struct sampleKernels* kernels = getSampleKernels(&ir);
+   int numFilters = ir.formatElements.numChannels;
+   if(!kernels->toFloat || ir.frames.numFrames == 0) {
+      printf("Impulse response %s is empty or not in a supported sample format.", irfilename);
+      exit(1);
+   }
+   if(ir.formatElements.sampleRate != pFormat->sampleRate || 
+      (numFilters != 1 && numFilters != pFormat->numChannels)) {
+      printf("Impulse response %s must have the file's sample rate and one channel or one per "
+             "channel of the file.", irfilename);
+      exit(1);
+   }
+
+   //One partition holds the whole of a short response; long ones are cut into several
+   struct convolver* pConvolver = (struct convolver*)calloc(1, sizeof(struct convolver));
+   size_t numTaps = ir.frames.numFrames;
+   size_t partitionFrames = CONVMINPARTITION;
+   while(partitionFrames < numTaps && partitionFrames < CONVMAXPARTITION) {
+      partitionFrames *= 2;
+   }
+   size_t numBins = partitionFrames + 1;
+   int numPartitions = (int)((numTaps + partitionFrames - 1) / partitionFrames);
+   int numChannels = pFormat->numChannels;
+   float* taps = (float*)malloc(numTaps * numFilters * sizeof(float));
+   float* window = (float*)malloc(2 * partitionFrames * sizeof(float));
+   if(!pConvolver || !taps || !window) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   *pConvolver = (struct convolver){ partitionFrames, numBins, numPartitions, numFilters, 
+                                     numChannels };
+   kernels->toFloat(ir.dataElements.subChunkData, taps, numTaps * numFilters);
+   poolRelease(&pool, irMem);
+   poolDestroy(&pool);
+
+   pConvolver->twiddleRe = (float*)malloc(partitionFrames * sizeof(float));
+   pConvolver->twiddleIm = (float*)malloc(partitionFrames * sizeof(float));
+   pConvolver->bitReverse = (uint32_t*)malloc(partitionFrames * sizeof(uint32_t));
+   pConvolver->realTwiddleRe = (float*)malloc(partitionFrames * sizeof(float));
+   pConvolver->realTwiddleIm = (float*)malloc(partitionFrames * sizeof(float));
+   size_t spectraSize = (size_t)numFilters * numPartitions * numBins;
+   pConvolver->filterRe = (float*)malloc(spectraSize * sizeof(float));
+   pConvolver->filterIm = (float*)malloc(spectraSize * sizeof(float));
+   pConvolver->channels = (struct convolverChannel*)calloc(numChannels, 
+                                                           sizeof(struct convolverChannel));
+   if(!pConvolver->twiddleRe || !pConvolver->twiddleIm || !pConvolver->bitReverse || 
+      !pConvolver->realTwiddleRe || !pConvolver->realTwiddleIm || !pConvolver->filterRe || 
+      !pConvolver->filterIm || !pConvolver->channels) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   buildFftTables(partitionFrames, pConvolver->twiddleRe, pConvolver->twiddleIm, 
+                  pConvolver->bitReverse);
+   const double pi = 3.14159265358979323846;
+   for(size_t k = 0; k < partitionFrames; ++k) {
+      pConvolver->realTwiddleRe[k] = (float)cos(-pi * k / partitionFrames);
+      pConvolver->realTwiddleIm[k] = (float)sin(-pi * k / partitionFrames);
+   }
+   for(int f = 0; f < numFilters; ++f) {
+      for(int p = 0; p < numPartitions; ++p) {
+         size_t spectrum = ((size_t)f * numPartitions + p) * numBins;
+         memset(window, 0, 2 * partitionFrames * sizeof(float));
+         for(size_t k = 0; k < partitionFrames && p * partitionFrames + k < numTaps; ++k) {
+            window[k] = taps[(p * partitionFrames + k) * numFilters + f];
+         }
+         forwardRealFft(pConvolver, window, pConvolver->filterRe + spectrum, 
+                        pConvolver->filterIm + spectrum);
+      }
+   }
+   free(taps);
+   free(window);
+   for(int c = 0; c < numChannels; ++c) {
+      struct convolverChannel* pChannel = &pConvolver->channels[c];
+      pChannel->window = (float*)calloc(2 * partitionFrames, sizeof(float));
+      pChannel->output = (float*)malloc(2 * partitionFrames * sizeof(float));
+      pChannel->delayRe = (float*)calloc((size_t)numPartitions * numBins, sizeof(float));
+      pChannel->delayIm = (float*)calloc((size_t)numPartitions * numBins, sizeof(float));
+      pChannel->re = (float*)malloc(numBins * sizeof(float));
+      pChannel->im = (float*)malloc(numBins * sizeof(float));
+      if(!pChannel->window || !pChannel->output || !pChannel->delayRe || !pChannel->delayIm || 
+         !pChannel->re || !pChannel->im) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+   }
+   fprintf(statusStream(), "Convolving with %s: %zu taps in %d partitions of %zu\n", irfilename, 
+           numTaps, numPartitions, partitionFrames);
+   return pConvolver;
+}
+
+/**
+ * @brief Fills the tables the FFT kernel needs for a transform of n points: the twiddles of every
+ *        stage of butterflies and the bit-reversed order of the inputs.
+ * 
+ * @param n the size of the transform, a power of two
+ * @param twiddleRe holds the real parts of the twiddles, n values
+ * @param twiddleIm holds the imaginary parts of the twiddles, n values
+ * @param bitReverse holds the bit-reversed index of every input, n values
+ */
+void buildFftTables(size_t n, float* twiddleRe, float* twiddleIm, uint32_t* bitReverse) {
+   const double pi = 3.14159265358979323846;
+   for(size_t half = 1; half < n; half *= 2) {
+      for(size_t k = 0; k < half; ++k) {
+         twiddleRe[half - 1 + k] = (float)cos(-pi * k / half);
+         twiddleIm[half - 1 + k] = (float)sin(-pi * k / half);
+      }
+   }
+   int bits = 0;
+   while(((size_t)1 << bits) < n) {
+      ++bits;
+   }
+   //Each index reverses to its half's reversal shifted down, with its low bit on top
+   bitReverse[0] = 0;
+   for(size_t i = 1; i < n; ++i) {
+      bitReverse[i] = (bitReverse[i >> 1] >> 1) | (uint32_t)((i & 1) << (bits - 1));
+   }
+}
+
+/**
+ * @brief Frees a convolver and everything it holds.
+ * 
+ * @param pConvolver a pointer to the convolver to be freed
+ */
+void destroyConvolver(struct convolver* pConvolver) {
+   for(int c = 0; c < pConvolver->numChannels; ++c) {
+      struct convolverChannel* pChannel = &pConvolver->channels[c];
+      free(pChannel->window);
+      free(pChannel->output);
+      free(pChannel->delayRe);
+      free(pChannel->delayIm);
+      free(pChannel->re);
+      free(pChannel->im);
+   }
+   free(pConvolver->channels);
+   free(pConvolver->twiddleRe);
+   free(pConvolver->twiddleIm);
+   free(pConvolver->bitReverse);
+   free(pConvolver->realTwiddleRe);
+   free(pConvolver->realTwiddleIm);
+   free(pConvolver->filterRe);
+   free(pConvolver->filterIm);
+   free(pConvolver);
+}
+
+/**
+ * @brief Transforms a window of 2 * partitionFrames real samples. Even and odd samples are packed
+ *        as the real and imaginary parts of partitionFrames complex values, transformed together, 
+ *        and the two halves' spectra are separated and combined into the window's spectrum.
+ * 
+ * @param pConvolver a pointer to the convolver holding the FFT tables
+ * @param samples the window of real samples
+ * @param re holds the real parts of the partitionFrames + 1 bins
+ * @param im holds the imaginary parts of the partitionFrames + 1 bins
+ */
+void forwardRealFft(const struct convolver* pConvolver, const float* samples, float* re, 
+                    float* im) {
+   size_t n = pConvolver->partitionFrames;
+   for(size_t i = 0; i < n; ++i) {
+      re[i] = samples[2 * i];
+      im[i] = samples[2 * i + 1];
+   }
+   FLOATKERNELS[kernelLevel].fft(re, im, n, pConvolver->twiddleRe, pConvolver->twiddleIm, 
+                                 pConvolver->bitReverse);
+   const float* wRe = pConvolver->realTwiddleRe;
+   const float* wIm = pConvolver->realTwiddleIm;
+   //Bins k and n - k are built from the same pair of values, so they are done together
+   for(size_t k = 1; k <= n / 2; ++k) {
+      float aRe = re[k], aIm = im[k], cRe = re[n - k], cIm = im[n - k];
+      float evenRe = (aRe + cRe) / 2, evenIm = (aIm - cIm) / 2;
+      float oddRe = (aIm + cIm) / 2, oddIm = (cRe - aRe) / 2;
+      float tRe = wRe[k] * oddRe - wIm[k] * oddIm;
+      float tIm = wRe[k] * oddIm + wIm[k] * oddRe;
+      re[k] = evenRe + tRe;
+      im[k] = evenIm + tIm;
+      re[n - k] = evenRe - tRe;
+      im[n - k] = tIm - evenIm;
+   }
+   float dc = re[0], nyquist = im[0];
+   re[0] = dc + nyquist;
+   re[n] = dc - nyquist;
+   im[0] = im[n] = 0;
+}
+
+/**
+ * @brief Inverts forwardRealFft, scaling the result so the round trip is the identity.
+ * 
+ * @param pConvolver a pointer to the convolver holding the FFT tables
+ * @param re the real parts of the partitionFrames + 1 bins, overwritten
+ * @param im the imaginary parts of the partitionFrames + 1 bins, overwritten
+ * @param samples holds the window of 2 * partitionFrames real samples
+ */
+void inverseRealFft(const struct convolver* pConvolver, float* re, float* im, float* samples) {
+   size_t n = pConvolver->partitionFrames;
+   const float* wRe = pConvolver->realTwiddleRe;
+   const float* wIm = pConvolver->realTwiddleIm;
+   for(size_t k = 1; k <= n / 2; ++k) {
+      float aRe = re[k], aIm = im[k], cRe = re[n - k], cIm = im[n - k];
+      float evenRe = (aRe + cRe) / 2, evenIm = (aIm - cIm) / 2;
+      float diffRe = (aRe - cRe) / 2, diffIm = (aIm + cIm) / 2;
+      float oddRe = diffRe * wRe[k] + diffIm * wIm[k];
+      float oddIm = diffIm * wRe[k] - diffRe * wIm[k];
+      re[k] = evenRe - oddIm;
+      im[k] = evenIm + oddRe;
+      re[n - k] = evenRe + oddIm;
+      im[n - k] = oddRe - evenIm;
+   }
+   float dc = re[0], nyquist = re[n];
+   re[0] = (dc + nyquist) / 2;
+   im[0] = (dc - nyquist) / 2;
+   //Swapping the real and imaginary parts turns the forward transform into the inverse
+   FLOATKERNELS[kernelLevel].fft(im, re, n, pConvolver->twiddleRe, pConvolver->twiddleIm, 
+                                 pConvolver->bitReverse);
+   float scale = 1.0f / n;
+   for(size_t i = 0; i < n; ++i) {
+      samples[2 * i] = re[i] * scale;
+      samples[2 * i + 1] = im[i] * scale;
+   }
+}
+
+/**
+ * @brief Stage body of a convolver. The channels of a block are independent, so they are shared
+ *        among the workers.
+ * 
+ * @param pStage a pointer to the convolution stage
+ * @param samples the block of interleaved float frames, at most one partition long, convolved
+ *        in place
+ * @param numFrames the number of frames in the block
+ * @param numChannels the number of channels per frame
+ */
+void processConvolver(struct stage* pStage, float* samples, size_t numFrames, int numChannels) {
+   struct convolver* pConvolver = pStage->convolver;
+   pConvolver->samples = samples;
+   pConvolver->numFrames = numFrames;
+   parallelFor(fileWorkers < numChannels ? fileWorkers : numChannels, convolveChannels, 
+               pConvolver);
+}
+
+/**
+ * @brief Convolves one worker's share of the channels of the convolver's current block. Each
+ *        channel's last two blocks are transformed together, the newest spectrum enters the
+ *        delay line, and the sum of its products with the partition spectra is transformed back;
+ *        the second half of the result is the block's output.
+ * 
+ * @param pConvolver a pointer to the shared convolver
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the channels
+ */
+void convolveChannels(void* pConvolver, int worker, int numWorkers) {
+   struct convolver* pConv = (struct convolver*)pConvolver;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   size_t partitionFrames = pConv->partitionFrames, numBins = pConv->numBins;
+   int numChannels = pConv->numChannels;
+   for(int c = worker; c < numChannels; c += numWorkers) {
+      struct convolverChannel* pChannel = &pConv->channels[c];
+      float* window = pChannel->window;
+      float* re = pChannel->re;
+      float* im = pChannel->im;
+      for(size_t i = 0; i < partitionFrames; ++i) {
+         window[partitionFrames + i] = i < pConv->numFrames ? 
+                                       pConv->samples[i * numChannels + c] : 0;
+      }
+      pChannel->newest = (pChannel->newest + 1) % pConv->numPartitions;
+      forwardRealFft(pConv, window, pChannel->delayRe + pChannel->newest * numBins, 
+                     pChannel->delayIm + pChannel->newest * numBins);
+      memcpy(window, window + partitionFrames, partitionFrames * sizeof(float));
+
+      memset(re, 0, numBins * sizeof(float));
+      memset(im, 0, numBins * sizeof(float));
+      int filter = pConv->numFilters == 1 ? 0 : c;
+      for(int p = 0; p < pConv->numPartitions; ++p) {
+         //Partition p of the response meets the input from p blocks ago
+         int slot = (pChannel->newest - p + pConv->numPartitions) % pConv->numPartitions;
+         size_t spectrum = ((size_t)filter * pConv->numPartitions + p) * numBins;
+         floatKernels->multiplyAdd(re, im, pChannel->delayRe + slot * numBins, 
+                                   pChannel->delayIm + slot * numBins, 
+                                   pConv->filterRe + spectrum, pConv->filterIm + spectrum, 
+                                   numBins);
+      }
+      inverseRealFft(pConv, re, im, pChannel->output);
+      for(size_t i = 0; i < pConv->numFrames; ++i) {
+         pConv->samples[i * numChannels + c] = pChannel->output[partitionFrames + i];
+      }
+   }
+}
+
+/**
+ * @brief Validates the inputs following a -mix flag, which run up to the next flag or the end of
+ *        the arguments. Each input filename may be followed by its gain in dB.
+ * 
+ * @param index the index in argv at which the first filename resides
+ * @param pInputs holds the newly allocated inputs, each with its linear gain
+ * @param pNumInputs holds the number of inputs
+ * @return int the number of arguments the inputs and their gains take up
+ */
+int collectMixInputs(size_t index, int argc, char* argv[], struct mixInput** pInputs, 
+                     int* pNumInputs) {
+   int numArgs = 0, numInputs = 0;
+   struct mixInput* inputs = (struct mixInput*)malloc(argc * sizeof(struct mixInput));
+   if(!inputs) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   for(; index + numArgs < argc && !isValidFlag(argv[index + numArgs]); ++numArgs) {
+      char* arg = argv[index + numArgs];
+      if(isValidFilename(arg)) {
+         inputs[numInputs++] = (struct mixInput){ arg, 1 };
+         continue;
+      }
+      char* end;
+      double gain = strtod(arg, &end);
+      if(numInputs == 0 || end == arg || *end != '\0' || !isfinite(gain)) {
+         printf("Invalid mix input %s. Inputs must be .wav filenames, each optionally followed "
+                "by a gain in dB.", arg);
+         exit(1);
+      }
+      inputs[numInputs - 1].gain = (float)pow(10, gain / 20);
+   }
+   if(numInputs == 0) {
+      printf("No filenames specified. Please see README for usage.");
+      exit(1);
+   }
+   *pInputs = inputs;
+   *pNumInputs = numInputs;
+   return numArgs;
+}
+
+/**
+ * @brief Sums several .wav files of the same format into one output file, each scaled by its own
+ *        gain. The inputs are mapped, so only their sample data is read, once, and the output is
+ *        as long as the longest input. Workers claim blocks of frames, sum them in float so
+ *        nothing clips until the final conversion, and write each block at its offset.
+ * 
+ * @param inputs the files to be mixed and their gains
+ * @param numInputs the number of files to be mixed
+ * @param outputfilename the filename of the mixed output file
+ */
+void runMix(struct mixInput inputs[], int numInputs, char* outputfilename) {
+#ifdef _WIN32
+   printf("Mix mode is not supported on this platform.");
+   exit(1);
+#else
+   struct phaseTimer timer;
+   startPhase(&timer);
+   struct wav* wavs = (struct wav*)malloc(numInputs * sizeof(struct wav));
+   float* gains = (float*)malloc(numInputs * sizeof(float));
+   if(!wavs || !gains) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   size_t numFrames = 0;
+   for(int i = 0; i < numInputs; ++i) {
+      size_t length;
+      char* wavMem = mapInputFile(inputs[i].filename, &length);
+      parseWavFile(inputs[i].filename, (unsigned char*)wavMem, length, &wavs[i]);
+      printFile(&wavs[i]);
+      const struct fmt* pFormat = &wavs[i].formatElements;
+      const struct fmt* pFirst = &wavs[0].formatElements;
+      if(pFormat->audioForm != pFirst->audioForm || pFormat->numChannels != pFirst->numChannels || 
+         pFormat->sampleRate != pFirst->sampleRate || pFormat->blockAlign != pFirst->blockAlign || 
+         pFormat->bitsPerSample != pFirst->bitsPerSample || 
+         wavs[i].extraParamsSize != wavs[0].extraParamsSize || 
+         memcmp(wavs[i].extraParams, wavs[0].extraParams, wavs[0].extraParamsSize) != 0) {
+         printf("Input %s does not have the same format as %s.", inputs[i].filename, 
+                inputs[0].filename);
+         exit(1);
+      }
+      gains[i] = inputs[i].gain;
+      numFrames = wavs[i].frames.numFrames > numFrames ? wavs[i].frames.numFrames : numFrames;
+   }
+   const struct sampleKernels* kernels = getSampleKernels(&wavs[0]);
+   if(!kernels->toFloat) {
+      printf("Mixing is not supported for this sample format.");
+      exit(1);
+   }
+   endPhase(&timer, "Read");
+
+   //The output takes the first input's format and nothing else, with room left for the data
+   startPhase(&timer);
+   struct wav output = wavs[0];
+   output.numExtraSubChunks = 0;
+   output.numSubChunksBeforeData = 0;
+   output.editedInfo = NULL;
+   output.remappedMarkers = NULL;
+   output.rebuiltData = NULL;
+   output.frames = (struct frameMap){ 0, numFrames, numFrames, false, 1, false };
+   output.dataElements.subChunkData = NULL;
+   output.dataElements.subChunk2Size = (int)(numFrames * wavs[0].formatElements.blockAlign);
+   size_t length, dataOffset;
+   int outputfilehandle = createOutputFile(outputfilename, &output, &dataOffset, &length);
+   struct mix mix = { wavs, gains, numInputs, numFrames, kernels, 
+                      wavs[0].formatElements.numChannels, outputfilehandle, outputfilename, 
+                      dataOffset, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, mixSlice, &mix);
+   fprintf(statusStream(), "Mixed %d inputs: %zu frames, peak %.2f dBFS\n", numInputs, numFrames, 
+           20 * log10(mix.peak > 1e-10f ? mix.peak : 1e-10f));
+   if(mix.peak > 1 && getFormatTag(&wavs[0]) != WAVEFORMATIEEEFLOAT) {
+      fprintf(statusStream(), "The mix peaks over full scale and was clipped. Lower the gains to "
+              "avoid this.\n");
+   }
+   fprintf(statusStream(), "Bytes Written: %zu\n", length);
+   closeOutputFile(outputfilehandle, outputfilename);
+   endPhase(&timer, "Mix");
+   for(int i = 0; i < numInputs; ++i) {
+      munmap(wavs[i].fileBytes, wavs[i].fileLength);
+   }
+   free(wavs);
+   free(gains);
+#endif
+}
+
+/**
+ * @brief Claims blocks of frames of a mix one at a time. Each block of every input is converted
+ *        to float and accumulated with its gain, and the sum is converted back and written to
+ *        its place in the output file.
+ * 
+ * @param pMix a pointer to the shared mix struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers mixing blocks
+ */
+void mixSlice(void* pMix, int worker, int numWorkers) {
+#ifndef _WIN32
+   struct mix* pJob = (struct mix*)pMix;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   size_t frameSize = (size_t)pJob->kernels->bytesPerSample * pJob->numChannels;
+   size_t blockSamples = MIXBLOCKFRAMES * (size_t)pJob->numChannels;
+   float* sum = (float*)malloc(blockSamples * sizeof(float));
+   float* samples = (float*)malloc(blockSamples * sizeof(float));
+   unsigned char* out = (unsigned char*)malloc(MIXBLOCKFRAMES * frameSize);
+   if(!sum || !samples || !out) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   float peak = 0;
+   double sumSquares = 0;
+   while(true) {
+      pthread_mutex_lock(&pJob->lock);
+      size_t first = pJob->nextBlock++ * MIXBLOCKFRAMES;
+      pthread_mutex_unlock(&pJob->lock);
+      if(first >= pJob->numFrames) {
+         break;
+      }
+      size_t numFrames = pJob->numFrames - first < MIXBLOCKFRAMES ? pJob->numFrames - first : 
+                                                                     MIXBLOCKFRAMES;
+      memset(sum, 0, numFrames * pJob->numChannels * sizeof(float));
+      for(int i = 0; i < pJob->numInputs; ++i) {
+         //Shorter inputs end early and leave silence behind them
+         size_t inputFrames = pJob->inputs[i].frames.numFrames;
+         if(first >= inputFrames) {
+            continue;
+         }
+         size_t n = inputFrames - first < numFrames ? inputFrames - first : numFrames;
+         pJob->kernels->toFloat(pJob->inputs[i].dataElements.subChunkData + first * frameSize, 
+                                samples, n * pJob->numChannels);
+         floatKernels->mix(sum, samples, pJob->gains[i], n * pJob->numChannels);
+      }
+      floatKernels->stats(sum, numFrames * pJob->numChannels, &peak, &sumSquares);
+      pJob->kernels->fromFloat(sum, out, numFrames * pJob->numChannels);
+      writeAt(pJob->outputfilehandle, pJob->outputfilename, out, numFrames * frameSize, 
+              pJob->dataOffset + first * frameSize);
+   }
+   pthread_mutex_lock(&pJob->lock);
+   pJob->peak = peak > pJob->peak ? peak : pJob->peak;
+   pthread_mutex_unlock(&pJob->lock);
+   free(sum);
+   free(samples);
+   free(out);
+#endif
+}
+
+/**
+ * @brief Writes each channel of a wav struct's sound data to its own mono file, 
+ *        "<output name>_<n>.wav". Every file keeps the input's other subchunks, and an extensible
+ *        format keeps the speaker position of its channel. The channels are pulled out of the
+ *        interleaved data in one pass and all of the files are written concurrently.
+ * 
+ * @param outputfilename the filename the channel filenames are built from
+ * @param pSoundFile a pointer to the wav struct to be split
+ * @param reversed whether the sample frames are to be written in reverse order
+ */
+void writeChannels(char* outputfilename, struct wav* pSoundFile, bool reversed) {
+#ifdef _WIN32
+   printf("Splitting channels is not supported on this platform.");
+   exit(1);
+#else
+   const struct fmt* pFormat = &pSoundFile->formatElements;
+   int numChannels = pFormat->numChannels;
+   if(numChannels <= 0 || pFormat->blockAlign <= 0 || pFormat->blockAlign % numChannels != 0) {
+      printf("Splitting channels is not supported for this sample format.");
+      exit(1);
+   }
+   int sampleBytes = pFormat->blockAlign / numChannels;
+   size_t numFrames = pSoundFile->frames.numFrames;
+   uint32_t speakers = 0;
+   bool extensible = pFormat->audioForm == WAVEFORMATEXTENSIBLE && pSoundFile->extraParamsSize >= 8;
+   if(extensible) {
+      memcpy(&speakers, pSoundFile->extraParams + 4, sizeof(speakers));
+   }
+   int stemLength = (int)(strlen(outputfilename) - strlen(VALIDEXTENSION));
+   int digits = snprintf(NULL, 0, "%d", numChannels);
+   int* handles = (int*)malloc(numChannels * sizeof(int));
+   char** filenames = (char**)malloc(numChannels * sizeof(char*));
+   size_t* dataOffsets = (size_t*)malloc(numChannels * sizeof(size_t));
+   size_t* lengths = (size_t*)malloc(numChannels * sizeof(size_t));
+   int* widths = (int*)malloc(numChannels * sizeof(int));
+   unsigned char* params = (unsigned char*)malloc((size_t)numChannels *
+                                                  pSoundFile->extraParamsSize + 1);
+   if(!handles || !filenames || !dataOffsets || !lengths || !widths || !params) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   fprintf(statusStream(), "Splitting into %d channels\n", numChannels);
+   for(int c = 0; c < numChannels; ++c) {
+      filenames[c] = (char*)malloc(stemLength + digits + sizeof("_" VALIDEXTENSION));
+      if(!filenames[c]) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+      sprintf(filenames[c], SEGMENTFILENAME, stemLength, outputfilename, digits, c + 1);
+      //Each channel is the whole file narrowed to one channel, sharing everything else
+      struct wav channel = *pSoundFile;
+      channel.remappedMarkers = NULL;
+      channel.formatElements.numChannels = 1;
+      channel.formatElements.blockAlign = (short)sampleBytes;
+      channel.formatElements.byteRate = pFormat->sampleRate * sampleBytes;
+      channel.dataElements.subChunkData = NULL;
+      channel.dataElements.subChunk2Size = (int)(numFrames * sampleBytes);
+      if(pSoundFile->extraParamsSize > 0) {
+         channel.extraParams = params + (size_t)c * pSoundFile->extraParamsSize;
+         memcpy(channel.extraParams, pSoundFile->extraParams, pSoundFile->extraParamsSize);
+      }
+      if(extensible) {
+         //The channel's speaker is the mask's c-th set bit, if the mask names that many
+         uint32_t speaker = speakers;
+         for(int skipped = 0; skipped < c && speaker; ++skipped) {
+            speaker &= speaker - 1;
+         }
+         speaker &= ~(speaker - 1);
+         memcpy(channel.extraParams + 4, &speaker, sizeof(speaker));
+      }
+      handles[c] = createOutputFile(filenames[c], &channel, &dataOffsets[c], &lengths[c]);
+      free(channel.remappedMarkers);
+      widths[c] = sampleBytes;
+   }
+   const unsigned char* source = pSoundFile->dataElements.subChunkData;
+   size_t blockFrames = CHANNELBLOCKBYTES / pFormat->blockAlign;
+   struct channelJob job = { &source, &numFrames, widths, numChannels, pFormat->blockAlign, 
+                             handles, filenames, dataOffsets, numFrames, 
+                             blockFrames > 0 ? blockFrames : 1, 0, 0, true, reversed, 
+                             PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, shuffleChannelsSlice, &job);
+   for(int c = 0; c < numChannels; ++c) {
+      fprintf(statusStream(), "Wrote %zu bytes to file %s\n", lengths[c], filenames[c]);
+      closeOutputFile(handles[c], filenames[c]);
+      free(filenames[c]);
+   }
+   free(handles);
+   free(filenames);
+   free(dataOffsets);
+   free(lengths);
+   free(widths);
+   free(params);
+#endif
+}
+
+/**
+ * @brief Interleaves the channels of several .wav files of the same sample format into one
+ *        output file, in the order the files are listed. The inputs are mapped, so only their
+ *        sample data is read, once, and the output is as long as the longest input, with shorter
+ *        inputs followed by silence. Extensible inputs with distinct speaker positions keep them.
+ * 
+ * @param inputfilenames the files whose channels are to be merged
+ * @param numInputs the number of files to be merged
+ * @param outputfilename the filename of the merged output file
+ */
+void runMerge(char* inputfilenames[], int numInputs, char* outputfilename) {
+#ifdef _WIN32
+   printf("Merge mode is not supported on this platform.");
+   exit(1);
+#else
+   struct phaseTimer timer;
+   startPhase(&timer);
+   struct wav* wavs = (struct wav*)malloc(numInputs * sizeof(struct wav));
+   const unsigned char** sources = (const unsigned char**)malloc(numInputs * sizeof(char*));
+   size_t* sourceFrames = (size_t*)malloc(numInputs * sizeof(size_t));
+   int* widths = (int*)malloc(numInputs * sizeof(int));
+   if(!wavs || !sources || !sourceFrames || !widths) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   size_t numFrames = 0;
+   int numChannels = 0, sampleBytes = 0;
+   uint32_t speakers = 0;
+   bool distinctSpeakers = true;
+   for(int i = 0; i < numInputs; ++i) {
+      size_t length;
+      char* wavMem = mapInputFile(inputfilenames[i], &length);
+      parseWavFile(inputfilenames[i], (unsigned char*)wavMem, length, &wavs[i]);
+      printFile(&wavs[i]);
+      const struct fmt* pFormat = &wavs[i].formatElements;
+      const struct fmt* pFirst = &wavs[0].formatElements;
+      if(pFormat->numChannels <= 0 || pFormat->blockAlign % pFormat->numChannels != 0) {
+         printf("Merging channels is not supported for the sample format of %s.", 
+                inputfilenames[i]);
+         exit(1);
+      }
+      if(i == 0) {
+         sampleBytes = pFormat->blockAlign / pFormat->numChannels;
+      }
+      if(pFormat->audioForm != pFirst->audioForm || pFormat->sampleRate != pFirst->sampleRate || 
+         pFormat->bitsPerSample != pFirst->bitsPerSample || 
+         pFormat->blockAlign != sampleBytes * pFormat->numChannels) {
+         printf("Input %s does not have the same sample format as %s.", inputfilenames[i], 
+                inputfilenames[0]);
+         exit(1);
+      }
+      if(pFormat->audioForm == WAVEFORMATEXTENSIBLE && wavs[i].extraParamsSize >= 8) {
+         uint32_t inputSpeakers;
+         memcpy(&inputSpeakers, wavs[i].extraParams + 4, sizeof(inputSpeakers));
+         distinctSpeakers = distinctSpeakers && !(speakers & inputSpeakers) && 
+                            __builtin_popcount(inputSpeakers) == pFormat->numChannels;
+         speakers |= inputSpeakers;
+      }
+      numChannels += pFormat->numChannels;
+      sources[i] = wavs[i].dataElements.subChunkData;
+      sourceFrames[i] = wavs[i].frames.numFrames;
+      widths[i] = pFormat->blockAlign;
+      numFrames = sourceFrames[i] > numFrames ? sourceFrames[i] : numFrames;
+   }
+   if((long)numChannels * sampleBytes > SHRT_MAX) {
+      printf("The merged file would have too many channels.");
+      exit(1);
+   }
+   endPhase(&timer, "Read");
+
+   //The output takes the first input's format widened to every channel, and nothing else
+   startPhase(&timer);
+   struct wav output = wavs[0];
+   output.numExtraSubChunks = 0;
+   output.numSubChunksBeforeData = 0;
+   output.editedInfo = NULL;
+   output.remappedMarkers = NULL;
+   output.rebuiltData = NULL;
+   output.frames = (struct frameMap){ 0, numFrames, numFrames, false, 1, false };
+   output.formatElements.numChannels = (short)numChannels;
+   output.formatElements.blockAlign = (short)(numChannels * sampleBytes);
+   output.formatElements.byteRate = output.formatElements.sampleRate * numChannels * sampleBytes;
+   output.dataElements.subChunkData = NULL;
+   output.dataElements.subChunk2Size = (int)(numFrames * output.formatElements.blockAlign);
+   unsigned char* params = (unsigned char*)malloc(output.extraParamsSize + 1);
+   if(!params) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   if(output.extraParamsSize > 0) {
+      memcpy(params, output.extraParams, output.extraParamsSize);
+      output.extraParams = params;
+   }
+   if(output.formatElements.audioForm == WAVEFORMATEXTENSIBLE && output.extraParamsSize >= 8) {
+      speakers = distinctSpeakers ? speakers : 0;
+      memcpy(params + 4, &speakers, sizeof(speakers));
+   }
+   size_t length, dataOffset;
+   int outputfilehandle = createOutputFile(outputfilename, &output, &dataOffset, &length);
+   //Unsigned 8-bit samples are silent at their midpoint
+   unsigned char silence = getFormatTag(&output) != WAVEFORMATIEEEFLOAT && 
+                           output.formatElements.bitsPerSample == 8 ? 0x80 : 0;
+   size_t blockFrames = CHANNELBLOCKBYTES / output.formatElements.blockAlign;
+   struct channelJob job = { sources, sourceFrames, widths, numInputs, 
+                             output.formatElements.blockAlign, &outputfilehandle, 
+                             &outputfilename, &dataOffset, numFrames, 
+                             blockFrames > 0 ? blockFrames : 1, 0, silence, false, false, 
+                             PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, shuffleChannelsSlice, &job);
+   fprintf(statusStream(), "Merged %d inputs: %d channels, %zu frames\n", numInputs, numChannels, 
+           numFrames);
+   fprintf(statusStream(), "Bytes Written: %zu\n", length);
+   closeOutputFile(outputfilehandle, outputfilename);
+   endPhase(&timer, "Merge");
+   for(int i = 0; i < numInputs; ++i) {
+      munmap(wavs[i].fileBytes, wavs[i].fileLength);
+   }
+   free(wavs);
+   free(sources);
+   free(sourceFrames);
+   free(widths);
+   free(params);
+#endif
+}
+
+/**
+ * @brief Claims blocks of frames of a channel split or merge one at a time. Each block is
+ *        shuffled a tile of interleaved frames at a time, copying every group's samples of the
+ *        tile before moving on, and then written to its place in every output file.
+ * 
+ * @param pJob a pointer to the shared channel job
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers shuffling blocks
+ */
+void shuffleChannelsSlice(void* pJob, int worker, int numWorkers) {
+   struct channelJob* job = (struct channelJob*)pJob;
+   size_t frameSize = job->frameSize;
+   size_t tileFrames = CHANNELTILEBYTES / frameSize > 0 ? CHANNELTILEBYTES / frameSize : 1;
+   unsigned char* buffer = (unsigned char*)malloc(job->blockFrames * frameSize);
+   if(!buffer) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   while(true) {
+      pthread_mutex_lock(&job->lock);
+      size_t first = job->nextBlock++ * job->blockFrames;
+      pthread_mutex_unlock(&job->lock);
+      if(first >= job->numFrames) {
+         break;
+      }
+      size_t numFrames = job->numFrames - first < job->blockFrames ? job->numFrames - first : 
+                                                                     job->blockFrames;
+      for(size_t tile = 0; tile < numFrames; tile += tileFrames) {
+         size_t tileLength = numFrames - tile < tileFrames ? numFrames - tile : tileFrames;
+         size_t frame = first + tile, offset = 0;
+         for(int g = 0; g < job->numGroups; ++g) {
+            int width = job->widths[g];
+            if(job->split) {
+               //Each channel gathers into its own run of the block, in playing order
+               const unsigned char* src = job->sources[0] + offset;
+               long stride = (long)frameSize;
+               if(job->reversed) {
+                  src += (job->numFrames - 1 - frame) * frameSize;
+                  stride = -stride;
+               }
+               else {
+                  src += frame * frameSize;
+               }
+               copySamples(buffer + offset * numFrames + tile * width, width, src, stride, 
+                           tileLength, width);
+            }
+            else {
+               //Inputs that have run out are filled with silence
+               size_t available = frame < job->sourceFrames[g] ? job->sourceFrames[g] - frame : 0;
+               available = available < tileLength ? available : tileLength;
+               unsigned char* dst = buffer + tile * frameSize + offset;
+               copySamples(dst, (long)frameSize, job->sources[g] + frame * width, width, available, 
+                           width);
+               for(size_t i = available; i < tileLength; ++i) {
+                  memset(dst + i * frameSize, job->silence, width);
+               }
+            }
+            offset += width;
+         }
+      }
+      if(job->split) {
+         size_t offset = 0;
+         for(int g = 0; g < job->numGroups; ++g) {
+            size_t width = job->widths[g];
+            writeAt(job->outputfilehandles[g], job->outputfilenames[g], 
+                    buffer + offset * numFrames, numFrames * width, 
+                    job->dataOffsets[g] + first * width);
+            offset += width;
+         }
+      }
+      else {
+         writeAt(job->outputfilehandles[0], job->outputfilenames[0], buffer, numFrames * frameSize, 
+                 job->dataOffsets[0] + first * frameSize);
+      }
+   }
+   free(buffer);
+}
+
+/**
+ * @brief Copies samples of one width between two strided runs of memory. The common widths get
+ *        loops of their own, so each sample is moved by a single load and store.
+ * 
+ * @param dst the first sample to be written
+ * @param dstStride the distance in bytes from one written sample to the next
+ * @param src the first sample to be read
+ * @param srcStride the distance in bytes from one read sample to the next, negative to read
+ *        backwards
+ * @param numSamples the number of samples to be copied
+ * @param width the width of a sample in bytes
+ */
+void copySamples(unsigned char* dst, long dstStride, const unsigned char* src, long srcStride, 
+                 size_t numSamples, int width) {
+   switch(width) {
+#define COPYSAMPLES(WIDTH) \
+      for(size_t i = 0; i < numSamples; ++i, dst += dstStride, src += srcStride) { \
+         memcpy(dst, src, WIDTH); \
+      } \
+      break;
+      case 1: COPYSAMPLES(1)
+      case 2: COPYSAMPLES(2)
+      case 3: COPYSAMPLES(3)
+      case 4: COPYSAMPLES(4)
+      case 8: COPYSAMPLES(8)
+      default: COPYSAMPLES(width)
+#undef COPYSAMPLES
+   }
+}
+
+/**
+ * @brief Checks to make sure there is a valid tolerance in the command-line argument following a
+ *        -tol flag: a level in dBFS no higher than full scale.
+ * 
+ * @param index the index at which the tolerance resides
+ */
+void validateTolerance(size_t index, int argc, char* argv[]) {
+   if(index >= argc) {
+      printf("No tolerance specified. Please see README for usage.");
+      exit(1);
+   }
+   char* end;
+   double tolerance = strtod(argv[index], &end);
+   if(end == argv[index] || *end != '\0' || !isfinite(tolerance) || tolerance > 0) {
+      printf("Invalid tolerance %s. Tolerances are levels in dBFS of at most 0.", argv[index]);
+      exit(1);
+   }
+}
+
+/**
+ * @brief Compares the sound data of two .wav files, ignoring everything else in them. Files of
+ *        the same sample format are compared byte for byte and only blocks that differ are
+ *        decoded; files of different bit depths or sample types are compared as float samples.
+ *        Reports the first difference and the largest and RMS differences: over the frames both
+ *        files have when a tolerance is given, and over the blocks examined before the scan
+ *        stopped otherwise.
+ * 
+ * @param firstfilename the name of the first file to be compared
+ * @param secondfilename the name of the second file to be compared
+ * @return true if the files have the same number of frames and every pair of samples matches, or
+ *         differs by no more than the tolerance.
+ *         false otherwise.
+ */
+bool runCompare(char* firstfilename, char* secondfilename) {
+#ifdef _WIN32
+   printf("Compare mode is not supported on this platform.");
+   exit(1);
+#else
+   struct phaseTimer timer;
+   startPhase(&timer);
+   struct wav first, second;
+   size_t firstLength, secondLength;
+   char* firstMem = mapInputFile(firstfilename, &firstLength);
+   char* secondMem = mapInputFile(secondfilename, &secondLength);
+   parseWavFile(firstfilename, (unsigned char*)firstMem, firstLength, &first);
+   parseWavFile(secondfilename, (unsigned char*)secondMem, secondLength, &second);
+   printFile(&first);
+   printFile(&second);
+   const struct fmt* pFirst = &first.formatElements;
+   const struct fmt* pSecond = &second.formatElements;
+   if(pFirst->numChannels != pSecond->numChannels || pFirst->sampleRate != pSecond->sampleRate) {
+      printf("%s and %s cannot be compared, as they differ in channels or sample rate.", 
+             firstfilename, secondfilename);
+      exit(1);
+   }
+   const struct sampleKernels* firstKernels = getSampleKernels(&first);
+   const struct sampleKernels* secondKernels = getSampleKernels(&second);
+   bool sameFormat = getFormatTag(&first) == getFormatTag(&second) && 
+                     pFirst->bitsPerSample == pSecond->bitsPerSample && 
+                     pFirst->blockAlign == pSecond->blockAlign;
+   if((!sameFormat || !exactCompare) && (!firstKernels->toFloat || !secondKernels->toFloat)) {
+      printf("Only exact comparisons of files in the same format are supported for this sample "
+             "format.");
+      exit(1);
+   }
+   endPhase(&timer, "Read");
+
+   startPhase(&timer);
+   size_t firstFrames = first.frames.numFrames, secondFrames = second.frames.numFrames;
+   struct compare compare = { &first, &second, firstKernels, secondKernels, sameFormat, 
+                              firstFrames < secondFrames ? firstFrames : secondFrames, 0, 0, 
+                              SIZE_MAX, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, compareSlice, &compare);
+   bool match = compare.firstDifference == SIZE_MAX && firstFrames == secondFrames;
+   if(firstFrames != secondFrames) {
+      fprintf(statusStream(), "Lengths differ: %zu frames against %zu frames\n", firstFrames, 
+              secondFrames);
+   }
+   if(compare.firstDifference != SIZE_MAX) {
+      fprintf(statusStream(), "First difference%s at frame %zu, channel %d\n", 
+              exactCompare ? "" : " over the tolerance", compare.firstDifference, 
+              compare.differenceChannel + 1);
+   }
+   //An exact comparison measures the differing files too, but only over the blocks it examined
+   bool measured = firstKernels->toFloat && secondKernels->toFloat;
+   if(!exactCompare || (measured && compare.firstDifference != SIZE_MAX)) {
+      char partial[80] = "";
+      if(compare.examinedFrames < compare.numFrames) {
+         snprintf(partial, sizeof(partial), " (partial, over %zu of %zu frames)", 
+                  compare.examinedFrames, compare.numFrames);
+      }
+      size_t numSamples = compare.examinedFrames * pFirst->numChannels;
+      double rms = numSamples > 0 ? sqrt(compare.sumSquares / numSamples) : 0;
+      fprintf(statusStream(), "Max Difference: %.2f dBFS%s\n", 
+              20 * log10(compare.maxError > 1e-10f ? compare.maxError : 1e-10f), partial);
+      fprintf(statusStream(), "RMS Difference: %.2f dBFS%s\n", 
+              20 * log10(rms > 1e-10 ? rms : 1e-10), partial);
+   }
+   fprintf(statusStream(), match ? "Sound data matches\n" : "Sound data differs\n");
+   endPhase(&timer, "Compare");
+   munmap(firstMem, firstLength);
+   munmap(secondMem, secondLength);
+   return match;
+#endif
+}
+
+/**
+ * @brief Claims blocks of frames of a comparison one at a time. A block whose bytes match needs
+ *        no decoding; otherwise its samples are converted to float and measured. In exact mode, 
+ *        blocks after a known difference are skipped.
+ * 
+ * @param pCompare a pointer to the shared compare struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers comparing blocks
+ */
+void compareSlice(void* pCompare, int worker, int numWorkers) {
+   struct compare* pJob = (struct compare*)pCompare;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   int numChannels = pJob->pFirst->formatElements.numChannels;
+   size_t firstFrameSize = pJob->pFirst->formatElements.blockAlign;
+   size_t secondFrameSize = pJob->pSecond->formatElements.blockAlign;
+   size_t blockSamples = COMPAREBLOCKFRAMES * (size_t)numChannels;
+   float* a = NULL;
+   float* b = NULL;
+   while(true) {
+      pthread_mutex_lock(&pJob->lock);
+      size_t first = pJob->nextBlock++ * COMPAREBLOCKFRAMES;
+      bool done = first >= pJob->numFrames || (exactCompare && pJob->firstDifference < first);
+      size_t numFrames = done ? 0 : pJob->numFrames - first < COMPAREBLOCKFRAMES ? 
+                                    pJob->numFrames - first : COMPAREBLOCKFRAMES;
+      pJob->examinedFrames += numFrames;
+      pthread_mutex_unlock(&pJob->lock);
+      if(done) {
+         break;
+      }
+      const unsigned char* firstData = pJob->pFirst->dataElements.subChunkData +
+                                       first * firstFrameSize;
+      const unsigned char* secondData = pJob->pSecond->dataElements.subChunkData +
+                                        first * secondFrameSize;
+      if(pJob->sameFormat && memcmp(firstData, secondData, numFrames * firstFrameSize) == 0) {
+         continue;
+      }
+      size_t difference = SIZE_MAX;
+      float maxError = 0;
+      double sumSquares = 0;
+      if(pJob->sameFormat && exactCompare) {
+         //The first differing byte gives the frame, and its place in the frame the channel
+         size_t byte = 0;
+         while(firstData[byte] == secondData[byte]) {
+            ++byte;
+         }
+         size_t sampleSize = firstFrameSize / numChannels > 0 ? firstFrameSize / numChannels : 1;
+         difference = byte / firstFrameSize * numChannels + byte % firstFrameSize / sampleSize;
+      }
+      //Differing blocks are measured whenever both formats can be decoded
+      if(pJob->firstKernels->toFloat && pJob->secondKernels->toFloat) {
+         if(!a) {
+            a = (float*)malloc(blockSamples * sizeof(float));
+            b = (float*)malloc(blockSamples * sizeof(float));
+            if(!a || !b) {
+               printf("Error in allocating memory.");
+               exit(1);
+            }
+         }
+         size_t numSamples = numFrames * numChannels;
+         pJob->firstKernels->toFloat(firstData, a, numSamples);
+         pJob->secondKernels->toFloat(secondData, b, numSamples);
+         floatKernels->difference(a, b, numSamples, &maxError, &sumSquares);
+         //Only a block that goes over the tolerance is searched for where it first does
+         if(difference == SIZE_MAX && maxError > compareTolerance) {
+            for(difference = 0; fabsf(a[difference] - b[difference]) <= compareTolerance;
+                ++difference) {
+            }
+         }
+      }
+      pthread_mutex_lock(&pJob->lock);
+      pJob->maxError = maxError > pJob->maxError ? maxError : pJob->maxError;
+      pJob->sumSquares += sumSquares;
+      if(difference != SIZE_MAX && first + difference / numChannels < pJob->firstDifference) {
+         pJob->firstDifference = first + difference / numChannels;
+         pJob->differenceChannel = (int)(difference % numChannels);
+      }
+      pthread_mutex_unlock(&pJob->lock);
+   }
+   free(a);
+   free(b);
+}
+
+/**
+ * @brief Finds the offset between two recordings of the same sound, such as the cameras and
+ *        recorders of one shoot. The envelopes of both are cross-correlated with one large FFT, 
+ *        which finds the lag to within a window, and the lags around it are then searched at the
+ *        full rate by normalized cross-correlation over an excerpt where both overlap. Given an
+ *        output file, writes a copy of the second recording shifted onto the first's timeline: 
+ *        trimmed or padded with silence at the start and cut or padded to the first's length.
+ * 
+ * @param referencefilename the name of the recording whose timeline the offset is measured on
+ * @param otherfilename the name of the recording to be aligned to it
+ * @param outputfilename the filename of the aligned copy, or NULL to only report the offset
+ */
+void runAlign(char* referencefilename, char* otherfilename, char* outputfilename) {
+#ifdef _WIN32
+   printf("Align mode is not supported on this platform.");
+   exit(1);
+#else
+   struct phaseTimer timer;
+   startPhase(&timer);
+   struct wav reference, other;
+   size_t referenceLength, otherLength;
+   char* referenceMem = mapInputFile(referencefilename, &referenceLength);
+   char* otherMem = mapInputFile(otherfilename, &otherLength);
+   parseWavFile(referencefilename, (unsigned char*)referenceMem, referenceLength, &reference);
+   parseWavFile(otherfilename, (unsigned char*)otherMem, otherLength, &other);
+   printFile(&reference);
+   printFile(&other);
+   int sampleRate = reference.formatElements.sampleRate;
+   if(other.formatElements.sampleRate != sampleRate || sampleRate <= 0 || 
+      !getSampleKernels(&reference)->toFloat || 
+      !getSampleKernels(&other)->toFloat) {
+      printf("%s and %s cannot be aligned, as they differ in sample rate or are not in a "
+             "supported sample format.", referencefilename, otherfilename);
+      exit(1);
+   }
+   endPhase(&timer, "Read");
+
+   //Coarse search: the lag of the largest cross-correlation of the envelopes, from one FFT of a
+   //size that holds every lag without wrapping around
+   startPhase(&timer);
+   size_t windowFrames = (size_t)sampleRate * ALIGNWINDOWMS / 1000;
+   windowFrames = windowFrames > 0 ? windowFrames : 1;
+   size_t referenceWindows, otherWindows;
+   float* referenceEnvelope = computeEnvelope(&reference, windowFrames, &referenceWindows);
+   float* otherEnvelope = computeEnvelope(&other, windowFrames, &otherWindows);
+   size_t n = 4;
+   while(n < referenceWindows + otherWindows) {
+      n *= 2;
+   }
+   struct spectraJob spectra = { .n = n };
+   float* twiddleRe = (float*)malloc(n * sizeof(float));
+   float* twiddleIm = (float*)malloc(n * sizeof(float));
+   uint32_t* bitReverse = (uint32_t*)malloc(n * sizeof(uint32_t));
+   for(int s = 0; s < 2; ++s) {
+      spectra.re[s] = (float*)calloc(n, sizeof(float));
+      spectra.im[s] = (float*)calloc(n, sizeof(float));
+      if(!spectra.re[s] || !spectra.im[s]) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+   }
+   if(!twiddleRe || !twiddleIm || !bitReverse) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   buildFftTables(n, twiddleRe, twiddleIm, bitReverse);
+   spectra.twiddleRe = twiddleRe;
+   spectra.twiddleIm = twiddleIm;
+   spectra.bitReverse = bitReverse;
+   memcpy(spectra.re[0], referenceEnvelope, referenceWindows * sizeof(float));
+   memcpy(spectra.re[1], otherEnvelope, otherWindows * sizeof(float));
+   free(referenceEnvelope);
+   free(otherEnvelope);
+   parallelFor(fileWorkers < 2 ? fileWorkers : 2, transformSlice, &spectra);
+   //The reference's spectrum times the conjugate of the other's transforms back to the
+   //correlation, lag k at index k and lag -k at index n - k
+   float* re = spectra.re[0];
+   float* im = spectra.im[0];
+   for(size_t k = 0; k < n; ++k) {
+      float productRe = re[k] * spectra.re[1][k] + im[k] * spectra.im[1][k];
+      float productIm = im[k] * spectra.re[1][k] - re[k] * spectra.im[1][k];
+      re[k] = productRe;
+      im[k] = productIm;
+   }
+   FLOATKERNELS[kernelLevel].fft(im, re, n, twiddleRe, twiddleIm, bitReverse);
+   long long lag = 0;
+   float best = -INFINITY;
+   for(size_t k = 0; k < n; ++k) {
+      long long candidate = k < referenceWindows ? (long long)k : (long long)k - (long long)n;
+      if(candidate <= -(long long)otherWindows || candidate >= (long long)referenceWindows) {
+         continue;
+      }
+      if(re[k] > best) {
+         best = re[k];
+         lag = candidate;
+      }
+   }
+   free(twiddleRe);
+   free(twiddleIm);
+   free(bitReverse);
+   for(int s = 0; s < 2; ++s) {
+      free(spectra.re[s]);
+      free(spectra.im[s]);
+   }
+
+   //Fine search: the lags around the coarse one, each scored over the middle of the overlap
+   long long coarse = lag * (long long)windowFrames;
+   long long referenceFrames = (long long)reference.frames.numFrames;
+   long long otherFrames = (long long)other.frames.numFrames;
+   long long overlapStart = coarse < 0 ? -coarse : 0;
+   long long overlapEnd = referenceFrames - coarse < otherFrames ? referenceFrames - coarse : 
+                                                                  otherFrames;
+   long long excerptFrames = overlapEnd - overlapStart;
+   long long longest = (long long)ALIGNREFINESECONDS * sampleRate;
+   excerptFrames = excerptFrames < longest ? excerptFrames : longest;
+   long long offset = coarse;
+   double correlation = 0;
+   if(excerptFrames > 0) {
+      long long excerptStart = (overlapStart + overlapEnd - excerptFrames) / 2;
+      long long radius = (long long)(ALIGNREFINEWINDOWS * windowFrames);
+      float* otherExcerpt = readMono(&other, excerptStart, (size_t)excerptFrames);
+      float* referenceExcerpt = readMono(&reference, excerptStart + coarse - radius, 
+                                         (size_t)(excerptFrames + 2 * radius));
+      struct refineJob refine = { referenceExcerpt, otherExcerpt, (size_t)excerptFrames, 
+                                  (int)(2 * radius + 1) };
+      refine.otherEnergy = FLOATKERNELS[kernelLevel].dot(otherExcerpt, otherExcerpt, 
+                                                         (size_t)excerptFrames);
+      refine.scores = (double*)malloc(refine.numLags * sizeof(double));
+      if(!refine.scores) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+      parallelFor(fileWorkers, refineSlice, &refine);
+      int bestLag = 0;
+      for(int j = 1; j < refine.numLags; ++j) {
+         bestLag = refine.scores[j] > refine.scores[bestLag] ? j : bestLag;
+      }
+      offset = coarse + bestLag - radius;
+      correlation = refine.scores[bestLag];
+      free(otherExcerpt);
+      free(referenceExcerpt);
+      free(refine.scores);
+   }
+   fprintf(statusStream(), "Offset: %lld frames (%.4f seconds), correlation %.3f\n", offset, 
+           (double)offset / sampleRate, correlation);
+   if(offset >= 0) {
+      fprintf(statusStream(), "%s starts %lld frames into %s\n", otherfilename, offset, 
+              referencefilename);
+   }
+   else {
+      fprintf(statusStream(), "%s starts %lld frames into %s\n", referencefilename, -offset, 
+              otherfilename);
+   }
+   endPhase(&timer, "Align");
+   if(outputfilename) {
+      startPhase(&timer);
+      writeAligned(outputfilename, &other, offset, reference.frames.numFrames);
+      endPhase(&timer, "Write");
+   }
+   munmap(referenceMem, referenceLength);
+   munmap(otherMem, otherLength);
+#endif
+}
+
+/**
+ * @brief Computes the envelope of a file's sound data: the RMS level of each window of frames
+ *        across all of its channels, less the mean level, so loud passages line up rather than
+ *        the recordings' overall levels. Workers share the windows.
+ * 
+ * @param pSoundFile a pointer to the wav struct whose envelope is computed
+ * @param windowFrames the number of frames in a window
+ * @param pNumWindows holds the number of windows, the last of which may be partial
+ * @return float* the newly allocated envelope
+ */
+float* computeEnvelope(const struct wav* pSoundFile, size_t windowFrames, size_t* pNumWindows) {
+   size_t numWindows = (pSoundFile->frames.numFrames + windowFrames - 1) / windowFrames;
+   float* envelope = (float*)malloc((numWindows + 1) * sizeof(float));
+   if(!envelope) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   struct envelopeJob job = { pSoundFile, getSampleKernels(pSoundFile), 
+                              windowFrames, numWindows, envelope };
+   parallelFor(fileWorkers, envelopeSlice, &job);
+   double mean = 0;
+   for(size_t w = 0; w < numWindows; ++w) {
+      mean += envelope[w];
+   }
+   mean = numWindows > 0 ? mean / numWindows : 0;
+   for(size_t w = 0; w < numWindows; ++w) {
+      envelope[w] -= (float)mean;
+   }
+   *pNumWindows = numWindows;
+   return envelope;
+}
+
+/**
+ * @brief Computes one worker's share of the windows of an envelope, decoding a chunk of windows
+ *        at a time.
+ * 
+ * @param pJob a pointer to the shared envelope job
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the windows
+ */
+void envelopeSlice(void* pJob, int worker, int numWorkers) {
+   struct envelopeJob* job = (struct envelopeJob*)pJob;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   int numChannels = job->pSoundFile->formatElements.numChannels;
+   size_t frameSize = job->pSoundFile->formatElements.blockAlign;
+   size_t numFrames = job->pSoundFile->frames.numFrames;
+   size_t firstWindow = job->numWindows * worker / numWorkers;
+   size_t lastWindow = job->numWindows * (worker + 1) / numWorkers;
+   float* samples = (float*)malloc(ALIGNCHUNKWINDOWS * job->windowFrames * numChannels *
+                                   sizeof(float));
+   if(!samples) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   for(size_t w = firstWindow; w < lastWindow; w += ALIGNCHUNKWINDOWS) {
+      size_t numWindows = lastWindow - w < ALIGNCHUNKWINDOWS ? lastWindow - w : ALIGNCHUNKWINDOWS;
+      size_t first = w * job->windowFrames;
+      size_t chunkFrames = numWindows * job->windowFrames;
+      chunkFrames = numFrames - first < chunkFrames ? numFrames - first : chunkFrames;
+      job->kernels->toFloat(job->pSoundFile->dataElements.subChunkData + first * frameSize, 
+                            samples, chunkFrames * numChannels);
+      for(size_t i = 0; i < numWindows; ++i) {
+         size_t start = i * job->windowFrames;
+         size_t length = chunkFrames - start < job->windowFrames ? chunkFrames - start : 
+                                                                   job->windowFrames;
+         float peak = 0;
+         double sumSquares = 0;
+         floatKernels->stats(samples + start * numChannels, length * numChannels, &peak, 
+                             &sumSquares);
+         job->envelope[w + i] = (float)sqrt(sumSquares / (length * numChannels));
+      }
+   }
+   free(samples);
+}
+
+/**
+ * @brief Transforms one worker's share of the two signals of a cross-correlation.
+ * 
+ * @param pJob a pointer to the shared spectra job
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the signals
+ */
+void transformSlice(void* pJob, int worker, int numWorkers) {
+   struct spectraJob* job = (struct spectraJob*)pJob;
+   for(int s = worker; s < 2; s += numWorkers) {
+      FLOATKERNELS[kernelLevel].fft(job->re[s], job->im[s], job->n, job->twiddleRe, 
+                                    job->twiddleIm, job->bitReverse);
+   }
+}
+
+/**
+ * @brief Decodes a run of a file's frames and mixes them down to mono. Frames before the start
+ *        or past the end of the file read as silence.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be read
+ * @param firstFrame the first frame to be read, which may be negative
+ * @param numFrames the number of frames to be read
+ * @return float* the newly allocated mono samples
+ */
+float* readMono(const struct wav* pSoundFile, long long firstFrame, size_t numFrames) {
+   const struct sampleKernels* kernels = getSampleKernels(pSoundFile);
+   int numChannels = pSoundFile->formatElements.numChannels;
+   size_t frameSize = pSoundFile->formatElements.blockAlign;
+   long long fileFrames = (long long)pSoundFile->frames.numFrames;
+   float* mono = (float*)calloc(numFrames + 1, sizeof(float));
+   float* frames = (float*)malloc(STAGEBLOCKFRAMES * numChannels * sizeof(float));
+   if(!mono || !frames) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   long long start = firstFrame > 0 ? firstFrame : 0;
+   long long end = firstFrame + (long long)numFrames < fileFrames ? 
+                   firstFrame + (long long)numFrames : fileFrames;
+   for(long long frame = start; frame < end; frame += STAGEBLOCKFRAMES) {
+      size_t blockFrames = end - frame < STAGEBLOCKFRAMES ? (size_t)(end - frame) : 
+                                                            STAGEBLOCKFRAMES;
+      kernels->toFloat(pSoundFile->dataElements.subChunkData + frame * frameSize, frames, 
+                       blockFrames * numChannels);
+      float* dst = mono + (frame - firstFrame);
+      for(size_t i = 0; i < blockFrames; ++i) {
+         float sum = 0;
+         for(int c = 0; c < numChannels; ++c) {
+            sum += frames[i * numChannels + c];
+         }
+         dst[i] = sum / numChannels;
+      }
+   }
+   free(frames);
+   return mono;
+}
+
+/**
+ * @brief Scores one worker's share of the lags of a fine search: the normalized cross-correlation
+ *        of the other recording's excerpt with the reference's excerpt at that lag.
+ * 
+ * @param pJob a pointer to the shared refine job
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the lags
+ */
+void refineSlice(void* pJob, int worker, int numWorkers) {
+   struct refineJob* job = (struct refineJob*)pJob;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   for(int j = worker; j < job->numLags; j += numWorkers) {
+      const float* reference = job->reference + j;
+      double energy = floatKernels->dot(reference, reference, job->length) * job->otherEnergy;
+      double product = floatKernels->dot(reference, job->other, job->length);
+      job->scores[j] = energy > 0 ? product / sqrt(energy) : 0;
+   }
 }
 
 /**
- * @brief Changes the sample rate of the passed .wav file, altering the byte rate to match it.
+ * @brief Writes a copy of a file's sound data shifted by an offset: silence where the offset is
+ *        positive, frames dropped from the start where it is negative, and silence after the
+ *        file's end up to the given length. The copy keeps the file's format and nothing else.
  * 
- * @param pSoundFile a pointer to the wav struct whose sample rate is to be changed
- * @param newSampleRate the desired sample rate
+ * @param outputfilename the filename of the aligned copy
+ * @param pSoundFile a pointer to the wav struct to be shifted
+ * @param offset the frame of the copy the file's first frame lands on
+ * @param numFrames the number of frames in the copy
  */
-void changeSampleRate(struct wav* pSoundFile, int newSampleRate) {
-   pSoundFile->formatElements.sampleRate = newSampleRate;
-   pSoundFile->formatElements.byteRate = (newSampleRate * pSoundFile->formatElements.blockAlign);
+void writeAligned(char* outputfilename, struct wav* pSoundFile, long long offset, 
+                  size_t numFrames) {
+   struct wav output = *pSoundFile;
+   size_t frameSize = pSoundFile->formatElements.blockAlign;
+   output.numExtraSubChunks = 0;
+   output.numSubChunksBeforeData = 0;
+   output.editedInfo = NULL;
+   output.remappedMarkers = NULL;
+   output.rebuiltData = NULL;
+   output.frames = (struct frameMap){ 0, numFrames, numFrames, false, 1, false };
+   output.dataElements.subChunkData = NULL;
+   output.dataElements.subChunk2Size = (int)(numFrames * frameSize);
+   size_t length, dataOffset;
+   int outputfilehandle = createOutputFile(outputfilename, &output, &dataOffset, &length);
+   //The file's frames land on [start, end) of the copy and silence fills the rest
+   long long fileFrames = (long long)pSoundFile->frames.numFrames;
+   long long start = offset > 0 ? offset : 0;
+   long long end = offset + fileFrames < (long long)numFrames ? offset + fileFrames : 
+                                                               (long long)numFrames;
+   start = start < (long long)numFrames ? start : (long long)numFrames;
+   end = end > start ? end : start;
+   unsigned char silence = getFormatTag(pSoundFile) != WAVEFORMATIEEEFLOAT && 
+                           pSoundFile->formatElements.bitsPerSample == 8 ? 0x80 : 0;
+   size_t silenceBytes = CHANNELBLOCKBYTES - CHANNELBLOCKBYTES % (frameSize > 0 ? frameSize : 1);
+   unsigned char* silent = (unsigned char*)malloc(silenceBytes);
+   if(!silent) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   memset(silent, silence, silenceBytes);
+   size_t runs[2][2] = { { 0, (size_t)start * frameSize }, 
+                         { (size_t)end * frameSize, numFrames * frameSize } };
+   for(int r = 0; r < 2; ++r) {
+      for(size_t at = runs[r][0]; at < runs[r][1]; at += silenceBytes) {
+         size_t bytes = runs[r][1] - at < silenceBytes ? runs[r][1] - at : silenceBytes;
+         writeAt(outputfilehandle, outputfilename, silent, bytes, dataOffset + at);
+      }
+   }
+   writeAt(outputfilehandle, outputfilename, 
+           pSoundFile->dataElements.subChunkData + (start - offset) * frameSize, 
+           (size_t)(end - start) * frameSize, dataOffset + (size_t)start * frameSize);
+   fprintf(statusStream(), "Bytes Written: %zu\n", length);
+   closeOutputFile(outputfilehandle, outputfilename);
+   free(silent);
 }
 
 /**
- * @brief Reverses the sound data in the passed wav struct
+ * @brief Determines whether a file's samples are integers, either plain PCM or an extensible
+ *        format whose subformat is PCM.
  * 
- * @param pSoundFile the pointer to the wav struct whose data is to be reversed
+ * @param pSoundFile a pointer to the wav struct to be checked
+ * @return true if the samples are integers.
+ *         false otherwise.
  */
-void reverseFile(struct wav* pSoundFile) {
-   int length = pSoundFile->dataElements.subChunk2Size;
-   int blockSize = pSoundFile->formatElements.blockAlign;
+bool isIntegerFormat(const struct wav* pSoundFile) {
+   return getFormatTag(pSoundFile) == WAVEFORMATPCM;
+}
 
-   unsigned char* temp = (unsigned char*)malloc(pSoundFile->formatElements.blockAlign);
-   if(!temp) {
-      printf("Error reversing the file.");
+/**
+ * @brief Finds whether every channel of a file's sound data holds the same samples, and how many
+ *        bits of each sample are used: its width less the low bits that are zero in every
+ *        sample. Workers share the data in whole periods of the reductions.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be analyzed
+ * @param pIdenticalChannels holds whether every channel matches the first
+ * @param pUsedBits holds the number of bits used, counted from the top of the sample, 0 for
+ *        silence and the full width for samples that are not integers
+ */
+void analyzeSamples(const struct wav* pSoundFile, bool* pIdenticalChannels, int* pUsedBits) {
+   int numChannels = pSoundFile->formatElements.numChannels;
+   size_t frameSize = pSoundFile->formatElements.blockAlign;
+   int sampleBytes = numChannels > 0 && frameSize % numChannels == 0 ? 
+                     (int)frameSize / numChannels : 0;
+   *pIdenticalChannels = false;
+   *pUsedBits = sampleBytes * 8;
+   if(sampleBytes == 0) {
+      return;
+   }
+   //The smallest multiple of both the lanes and the frame size
+   size_t period = ANALYSISLANES;
+   while(period % frameSize != 0) {
+      period += ANALYSISLANES;
+   }
+   int numWorkers = fileWorkers;
+   struct analysis analysis = { pSoundFile->dataElements.subChunkData, 
+                                pSoundFile->frames.numFrames * frameSize, period, sampleBytes };
+   analysis.ors = (unsigned char*)calloc(numWorkers * period, 1);
+   analysis.xors = (unsigned char*)calloc(numWorkers * period, 1);
+   unsigned char* frameOrs = (unsigned char*)calloc(frameSize, 1);
+   unsigned char* frameXors = (unsigned char*)calloc(frameSize, 1);
+   if(!analysis.ors || !analysis.xors || !frameOrs || !frameXors) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   parallelFor(numWorkers, analysisSlice, &analysis);
+   for(size_t i = 0; i < numWorkers * period; ++i) {
+      frameOrs[i % period % frameSize] |= analysis.ors[i];
+      frameXors[i % period % frameSize] |= analysis.xors[i];
+   }
+   //Each sample is XORed with the next channel's, so the last channel's bytes are not compared
+   bool identical = numChannels > 1;
+   for(size_t b = 0; b + sampleBytes < frameSize; ++b) {
+      identical = identical && frameXors[b] == 0;
+   }
+   *pIdenticalChannels = identical;
+   if(isIntegerFormat(pSoundFile) && sampleBytes <= 4) {
+      uint32_t used = 0;
+      for(int c = 0; c < numChannels; ++c) {
+         for(int b = 0; b < sampleBytes; ++b) {
+            used |= (uint32_t)frameOrs[c * sampleBytes + b] << (8 * b);
+         }
+      }
+      *pUsedBits = used ? sampleBytes * 8 - __builtin_ctz(used) : 0;
+   }
+   free(analysis.ors);
+   free(analysis.xors);
+   free(frameOrs);
+   free(frameXors);
+}
+
+/**
+ * @brief Reduces one worker's share of the sound data into the worker's own accumulators. Shares
+ *        are whole periods, so every byte lands at its position in the frame, and the last share
+ *        takes whatever is left over.
+ * 
+ * @param pAnalysis a pointer to the shared analysis struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers sharing the data
+ */
+void analysisSlice(void* pAnalysis, int worker, int numWorkers) {
+   struct analysis* pJob = (struct analysis*)pAnalysis;
+   size_t numPeriods = pJob->length / pJob->period;
+   size_t first = numPeriods * worker / numWorkers * pJob->period;
+   size_t last = worker == numWorkers - 1 ? pJob->length : 
+                                            numPeriods * (worker + 1) / numWorkers * pJob->period;
+   FLOATKERNELS[kernelLevel].byteReductions(pJob->data + first, last - first, pJob->period, 
+                                            pJob->sampleBytes, pJob->ors + worker * pJob->period, 
+                                            pJob->xors + worker * pJob->period);
+}
+
+/**
+ * @brief Prints whether a file's channels are identical and how many bits its samples use.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be analyzed
+ */
+void printAnalysis(struct wav* pSoundFile) {
+   bool identicalChannels;
+   int usedBits;
+   analyzeSamples(pSoundFile, &identicalChannels, &usedBits);
+   int numChannels = pSoundFile->formatElements.numChannels;
+   int sampleBits = numChannels > 0 ? pSoundFile->formatElements.blockAlign / numChannels * 8 : 0;
+   fprintf(statusStream(), "Identical Channels: %s\n", identicalChannels ? "Yes" : "No");
+   fprintf(statusStream(), "Bits Used: %d of %d\n", usedBits, sampleBits);
+}
+
+/**
+ * @brief Rewrites a file's sound data in the smallest format that holds it losslessly: one
+ *        channel if every channel is the same, and integer samples narrowed to the whole bytes
+ *        their used bits need. 8-bit samples are unsigned, so samples narrowed to a byte are
+ *        offset by half its range. The frames keep their order in memory.
+ * 
+ * @param pSoundFile a pointer to the wav struct to be repacked
+ */
+void repackFile(struct wav* pSoundFile) {
+   bool identicalChannels;
+   int usedBits;
+   analyzeSamples(pSoundFile, &identicalChannels, &usedBits);
+   struct fmt* pFormat = &pSoundFile->formatElements;
+   int numChannels = pFormat->numChannels;
+   if(numChannels <= 0 || pFormat->blockAlign % numChannels != 0) {
+      printf("Repacking is not supported for this sample format.\n");
+      return;
+   }
+   int sampleBytes = pFormat->blockAlign / numChannels;
+   int newChannels = identicalChannels ? 1 : numChannels;
+   int newBytes = sampleBytes;
+   if(isIntegerFormat(pSoundFile) && sampleBytes > 1 && sampleBytes <= 4) {
+      newBytes = usedBits > 8 ? (usedBits + 7) / 8 : 1;
+   }
+   if(newChannels == numChannels && newBytes == sampleBytes) {
+      fprintf(statusStream(), "Already in its smallest lossless format\n");
+      return;
+   }
+
+   //Each kept sample is its top bytes, since the bytes below them are zero in every sample
+   size_t numFrames = pSoundFile->frames.numFrames;
+   size_t newFrameSize = (size_t)newChannels * newBytes;
+   unsigned char* repacked = (unsigned char*)malloc(numFrames * newFrameSize + 1);
+   if(!repacked) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   const unsigned char* data = pSoundFile->dataElements.subChunkData;
+   for(int c = 0; c < newChannels; ++c) {
+      copySamples(repacked + c * newBytes, (long)newFrameSize, 
+                  data + c * sampleBytes + sampleBytes - newBytes, pFormat->blockAlign, numFrames, 
+                  newBytes);
+   }
+   if(newBytes == 1 && sampleBytes > 1) {
+      for(size_t i = 0; i < numFrames * newFrameSize; ++i) {
+         repacked[i] ^= 0x80;
+      }
+   }
+   free(pSoundFile->rebuiltData);
+   pSoundFile->rebuiltData = repacked;
+   pSoundFile->dataElements.subChunkData = repacked;
+   pSoundFile->dataElements.subChunk2Size = (int)(numFrames * newFrameSize);
+   pSoundFile->samplesAltered = true;
+   pFormat->numChannels = (short)newChannels;
+   pFormat->bitsPerSample = (short)(newBytes * 8);
+   pFormat->blockAlign = (short)newFrameSize;
+   pFormat->byteRate = pFormat->sampleRate * (int)newFrameSize;
+   //An extensible format keeps its subformat, with the valid bits and speakers of what is left
+   if(pFormat->audioForm == WAVEFORMATEXTENSIBLE && pSoundFile->extraParamsSize >= 8) {
+      unsigned char* params = (unsigned char*)malloc(pSoundFile->extraParamsSize);
+      if(!params) {
+         printf("Error in allocating memory.");
+         exit(1);
+      }
+      memcpy(params, pSoundFile->extraParams, pSoundFile->extraParamsSize);
+      uint16_t validBits;
+      memcpy(&validBits, params + 2, sizeof(validBits));
+      validBits = validBits > newBytes * 8 || newBytes != sampleBytes ? newBytes * 8 : validBits;
+      memcpy(params + 2, &validBits, sizeof(validBits));
+      if(newChannels == 1) {
+         uint32_t speakers;
+         memcpy(&speakers, params + 4, sizeof(speakers));
+         speakers &= ~(speakers - 1);
+         memcpy(params + 4, &speakers, sizeof(speakers));
+      }
+      free(pSoundFile->repackedParams);
+      pSoundFile->repackedParams = params;
+      pSoundFile->extraParams = params;
+   }
+   fprintf(statusStream(), "Repacked to %d channel%s of %d bits\n", newChannels, 
+           newChannels == 1 ? "" : "s", newBytes * 8);
+}
+
+/**
+ * @brief Finds the next run of silence in a stretch of sample data that can be left as a hole: 
+ *        whole pages of the output file, at least SPARSEMINBYTES long, whose bytes are all zero.
+ * 
+ * @param bytes the bytes to be written
+ * @param length the number of bytes to be written
+ * @param fileOffset the offset in the file the first byte is written at
+ * @param pStart holds the index of the byte the search starts at, replaced with the index of the
+ *        first byte of the run, or the length if there is none
+ * @return size_t the length of the run in bytes, or 0 if there is none
+ */
+size_t findZeroPages(const unsigned char* bytes, size_t length, size_t fileOffset, size_t* pStart) {
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   //Pages are counted from the start of the file, not of the bytes
+   size_t page = *pStart + (SPARSEPAGESIZE - (fileOffset + *pStart) % SPARSEPAGESIZE) %
+                           SPARSEPAGESIZE;
+   while(page + SPARSEMINBYTES <= length) {
+      size_t end = page;
+      while(end + SPARSEPAGESIZE <= length && floatKernels->allZero(bytes + end, SPARSEPAGESIZE)) {
+         end += SPARSEPAGESIZE;
+      }
+      if(end - page >= SPARSEMINBYTES) {
+         *pStart = page;
+         return end - page;
+      }
+      page = end + SPARSEPAGESIZE;
+   }
+   *pStart = length;
+   return 0;
+}
+
+/**
+ * @brief Punches holes in an output file where its sample data, already in place, has runs of
+ *        silence. Dirty pages in a hole are dropped, so they are never written back. File systems
+ *        without holes keep the zeros as they are.
+ * 
+ * @param outputfilehandle the handle of the output file
+ * @param bytes the sample data as it is in the file
+ * @param length the number of bytes of sample data
+ * @param fileOffset the offset of the sample data in the file
+ */
+void punchZeroPages(int outputfilehandle, const unsigned char* bytes, size_t length, 
+                    size_t fileOffset) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+   size_t start = 0;
+   size_t run = findZeroPages(bytes, length, fileOffset, &start);
+   while(run > 0) {
+      if(fallocate(outputfilehandle, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 
+                   (off_t)(fileOffset + start), (off_t)run) != 0) {
+         return;
+      }
+      start += run;
+      run = findZeroPages(bytes, length, fileOffset, &start);
+   }
+#endif
+}
+
+/**
+ * @brief Checks to make sure there is a filename in the command-line argument following an -edl
+ *        flag. The list is a text file, so any name that is not a flag is accepted.
+ * 
+ * @param index the index at which the filename resides
+ */
+void validateEdlFilename(size_t index, int argc, char* argv[]) {
+   if(index >= argc || isValidFlag(argv[index])) {
+      printf("No edit decision list specified. Please see README for usage.");
+      exit(1);
+   }
+}
+
+/**
+ * @brief Reads an edit decision list: one edit per line, each a first frame and an end frame of
+ *        the source, optionally followed by a gain in dB and fade-in and fade-out lengths in
+ *        frames. Blank lines and everything after a # are ignored. The edits are placed end to
+ *        end in the order listed.
+ * 
+ * @param edlfilename the filename of the edit decision list
+ * @param sourceFrames the number of frames in the source
+ * @param pNumEdits holds the number of edits
+ * @return struct edit* the newly allocated edits, in program order
+ */
+struct edit* parseEdl(char* edlfilename, size_t sourceFrames, int* pNumEdits) {
+   FILE* edl = fopen(edlfilename, "r");
+   if(!edl) {
+      printf("Error opening edit decision list %s", edlfilename);
+      exit(1);
+   }
+   struct edit* edits = NULL;
+   int numEdits = 0, capacity = 0;
+   size_t programFrames = 0;
+   char line[EDLLINELENGTH];
+   for(int lineNumber = 1; fgets(line, sizeof(line), edl); ++lineNumber) {
+      line[strcspn(line, "#\r\n")] = '\0';
+      char* fields[6];
+      int numFields = 0;
+      for(char* field = strtok(line, " \t"); field && numFields < 6; field = strtok(NULL, " \t")) {
+         fields[numFields++] = field;
+      }
+      if(numFields == 0) {
+         continue;
+      }
+      //Every field is a whole number of frames but the gain
+      bool valid = numFields >= 2 && numFields <= 5;
+      for(int f = 0; f < numFields && valid; ++f) {
+         char* end;
+         valid = f == 2 ? isfinite(strtod(fields[f], &end)) && end != fields[f] && *end == '\0' : 
+                          fields[f][strspn(fields[f], "0123456789")] == '\0';
+      }
+      if(!valid) {
+         printf("Invalid edit on line %d of %s. Edits are a first and end frame of the source, "
+                "optionally followed by a gain in dB and fade lengths in frames.", lineNumber, 
+                edlfilename);
+         exit(1);
+      }
+      struct edit edit = { strtoull(fields[0], NULL, 10), strtoull(fields[1], NULL, 10), 
+                           programFrames, numFields > 3 ? strtoull(fields[3], NULL, 10) : 0, 
+                           numFields > 4 ? strtoull(fields[4], NULL, 10) : 0, 
+                           numFields > 2 ? (float)pow(10, strtod(fields[2], NULL) / 20) : 1 };
+      if(edit.start >= edit.end || edit.end > sourceFrames) {
+         printf("Invalid range %s to %s on line %d of %s. Ranges must not be empty and must lie "
+                "within the source's %zu frames.", fields[0], fields[1], lineNumber, edlfilename, 
+                sourceFrames);
+         exit(1);
+      }
+      if(numEdits == capacity) {
+         capacity = capacity > 0 ? 2 * capacity : 64;
+         edits = (struct edit*)realloc(edits, capacity * sizeof(struct edit));
+         if(!edits) {
+            printf("Error in allocating memory.");
+            exit(1);
+         }
+      }
+      edits[numEdits++] = edit;
+      programFrames += edit.end - edit.start;
+   }
+   fclose(edl);
+   if(numEdits == 0) {
+      printf("No edits in %s. Please see README for usage.", edlfilename);
       exit(1);
    }
-   //Gathers the sample blocks and reverses them individually
-   for(int i = 0; i < length / 2; i+= blockSize) {
-      for(int j = 0; j < blockSize; j++) {
-         temp[j] = pSoundFile->dataElements.subChunkData[i + j];
-         pSoundFile->dataElements.subChunkData[i + j] = 
-            pSoundFile->dataElements.subChunkData[length - i + j];
-         pSoundFile->dataElements.subChunkData[length - i + j] = temp[j];
+   *pNumEdits = numEdits;
+   return edits;
+}
+
+/**
+ * @brief Renders a program from an edit decision list against one source file in a single pass.
+ *        The source is mapped, so only the ranges the edits use are ever read, and the cost
+ *        follows the program's length rather than the source's. Frames at unity gain outside
+ *        any fade are written straight from the source; the rest are converted to float, scaled
+ *        and converted back.
+ * 
+ * @param sourcefilename the filename of the source the edits are cut from
+ * @param edlfilename the filename of the edit decision list
+ * @param outputfilename the filename of the rendered program
+ */
+void runEdl(char* sourcefilename, char* edlfilename, char* outputfilename) {
+#ifdef _WIN32
+   printf("EDL mode is not supported on this platform.");
+   exit(1);
+#else
+   struct phaseTimer timer;
+   startPhase(&timer);
+   size_t sourceLength;
+   char* wavMem = mapInputFile(sourcefilename, &sourceLength);
+   struct wav source;
+   parseWavFile(sourcefilename, (unsigned char*)wavMem, sourceLength, &source);
+   printFile(&source);
+   int numEdits;
+   struct edit* edits = parseEdl(edlfilename, source.frames.numFrames, &numEdits);
+   const struct sampleKernels* kernels = getSampleKernels(&source);
+   for(int e = 0; e < numEdits && !kernels->toFloat; ++e) {
+      if(edits[e].gain != 1 || edits[e].fadeIn > 0 || edits[e].fadeOut > 0) {
+         printf("Gains and fades are not supported for this sample format.");
+         exit(1);
+      }
+   }
+   const struct edit* pLast = &edits[numEdits - 1];
+   size_t numFrames = pLast->programFrame + pLast->end - pLast->start;
+   endPhase(&timer, "Read");
+
+   //The output takes the source's format and nothing else, with room left for the data
+   startPhase(&timer);
+   struct wav output = source;
+   output.numExtraSubChunks = 0;
+   output.numSubChunksBeforeData = 0;
+   output.editedInfo = NULL;
+   output.remappedMarkers = NULL;
+   output.rebuiltData = NULL;
+   output.repackedParams = NULL;
+   output.frames = (struct frameMap){ 0, numFrames, numFrames, false, 1, false };
+   output.dataElements.subChunkData = NULL;
+   output.dataElements.subChunk2Size = (int)(numFrames * source.formatElements.blockAlign);
+   size_t length, dataOffset;
+   int outputfilehandle = createOutputFile(outputfilename, &output, &dataOffset, &length);
+   struct edlRender render = { &source, edits, numEdits, kernels, numFrames, outputfilehandle, 
+                               outputfilename, dataOffset, 0, PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, edlSlice, &render);
+   fprintf(statusStream(), "Rendered %d edits: %zu frames\n", numEdits, numFrames);
+   fprintf(statusStream(), "Bytes Written: %zu\n", length);
+   closeOutputFile(outputfilehandle, outputfilename);
+   endPhase(&timer, "Render");
+   munmap(wavMem, sourceLength);
+   free(edits);
+#endif
+}
+
+/**
+ * @brief Claims blocks of frames of a program one at a time and renders each edit that falls in
+ *        them. Runs at unity gain are written from the source mapping as they are; runs with a
+ *        gain or inside a fade are scaled frame by frame in float.
+ * 
+ * @param pRender a pointer to the shared edlRender struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers rendering blocks
+ */
+void edlSlice(void* pRender, int worker, int numWorkers) {
+#ifndef _WIN32
+   struct edlRender* pJob = (struct edlRender*)pRender;
+   const struct floatKernels* floatKernels = &FLOATKERNELS[kernelLevel];
+   int numChannels = pJob->pSource->formatElements.numChannels;
+   size_t frameSize = pJob->pSource->formatElements.blockAlign;
+   float* samples = NULL;
+   float* gains = NULL;
+   unsigned char* out = NULL;
+   while(true) {
+      pthread_mutex_lock(&pJob->lock);
+      size_t first = pJob->nextBlock++ * EDLBLOCKFRAMES;
+      pthread_mutex_unlock(&pJob->lock);
+      if(first >= pJob->numFrames) {
+         break;
+      }
+      size_t last = pJob->numFrames - first < EDLBLOCKFRAMES ? pJob->numFrames : 
+                                                               first + EDLBLOCKFRAMES;
+      //The last edit starting at or before the block
+      int e = 0;
+      for(int high = pJob->numEdits - 1; e < high; ) {
+         int middle = (e + high + 1) / 2;
+         if(pJob->edits[middle].programFrame <= first) {
+            e = middle;
+         }
+         else {
+            high = middle - 1;
+         }
+      }
+      for(size_t frame = first; frame < last; ++e) {
+         const struct edit* pEdit = &pJob->edits[e];
+         size_t editFrames = pEdit->end - pEdit->start;
+         size_t into = frame - pEdit->programFrame;
+         size_t n = pEdit->programFrame + editFrames < last ? editFrames - into : last - frame;
+         const unsigned char* src = pJob->pSource->dataElements.subChunkData +
+                                    (pEdit->start + into) * frameSize;
+         size_t offset = pJob->dataOffset + frame * frameSize;
+         frame += n;
+         if(pEdit->gain == 1 && into >= pEdit->fadeIn && into + n + pEdit->fadeOut <= editFrames) {
+            writeAt(pJob->outputfilehandle, pJob->outputfilename, src, n * frameSize, offset);
+            continue;
+         }
+         if(!samples) {
+            samples = (float*)malloc(EDLBLOCKFRAMES * (size_t)numChannels * sizeof(float));
+            gains = (float*)malloc(EDLBLOCKFRAMES * sizeof(float));
+            out = (unsigned char*)malloc(EDLBLOCKFRAMES * frameSize);
+            if(!samples || !gains || !out) {
+               printf("Error in allocating memory.");
+               exit(1);
+            }
+         }
+         //Fades are linear, from silence at the edit's first frame and to it at its last
+         for(size_t i = 0; i < n; ++i) {
+            size_t fromStart = into + i, toEnd = editFrames - 1 - into - i;
+            float ramp = fromStart < pEdit->fadeIn ? (float)fromStart / pEdit->fadeIn : 1;
+            if(toEnd < pEdit->fadeOut && (float)toEnd / pEdit->fadeOut < ramp) {
+               ramp = (float)toEnd / pEdit->fadeOut;
+            }
+            gains[i] = pEdit->gain * ramp;
+         }
+         pJob->kernels->toFloat(src, samples, n * numChannels);
+         floatKernels->applyGains(samples, gains, n, numChannels);
+         pJob->kernels->fromFloat(samples, out, n * numChannels);
+         writeAt(pJob->outputfilehandle, pJob->outputfilename, out, n * frameSize, offset);
+      }
+   }
+   free(samples);
+   free(gains);
+   free(out);
+#endif
+}
+
+/**
+ * @brief Checks the headers of several .wav files, and with -repair fixes those that can be fixed
+ *        in place. Workers claim files one at a time. Every file gets one line: OK, or what is
+ *        wrong with it and whether it was repaired.
+ * 
+ * @param filenames the names of the files to be checked
+ * @param numFiles the number of files to be checked
+ * @param repair whether to repair the files that can be
+ * @return true if every file is valid, or was repaired.
+ *         false otherwise.
+ */
+bool runValidate(char* filenames[], int numFiles, bool repair) {
+   struct phaseTimer timer;
+   startPhase(&timer);
+   struct validation validation = { filenames, numFiles, 0, 0, 0, repair, 
+                                    PTHREAD_MUTEX_INITIALIZER };
+   parallelFor(fileWorkers, validateSlice, &validation);
+   int numInvalid = numFiles - validation.numValid - validation.numRepaired;
+   fprintf(statusStream(), "Checked %d files: %d valid, %d repaired, %d invalid\n", numFiles, 
+           validation.numValid, validation.numRepaired, numInvalid);
+   endPhase(&timer, repair ? "Repair" : "Validate");
+   return numInvalid == 0;
+}
+
+/**
+ * @brief Claims files of a validation one at a time, checks each, and prints the outcome.
+ * 
+ * @param pValidation a pointer to the shared validation struct
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers checking files
+ */
+void validateSlice(void* pValidation, int worker, int numWorkers) {
+   struct validation* pJob = (struct validation*)pValidation;
+   while(true) {
+      pthread_mutex_lock(&pJob->lock);
+      int index = pJob->nextFile++;
+      pthread_mutex_unlock(&pJob->lock);
+      if(index >= pJob->numFiles) {
+         break;
+      }
+      char problems[MAXHEADERPROBLEMS] = "";
+      bool repaired = false;
+      bool valid = checkHeader(pJob->filenames[index], pJob->repair, problems, sizeof(problems), 
+                               &repaired);
+      pthread_mutex_lock(&printLock);
+      if(problems[0] == '\0') {
+         fprintf(statusStream(), "%s: OK\n", pJob->filenames[index]);
+      }
+      else {
+         fprintf(statusStream(), "%s: %s%s\n", pJob->filenames[index], problems, 
+                 repaired ? ", repaired" : valid ? "" : pJob->repair ? ", cannot be repaired" : "");
+      }
+      pthread_mutex_unlock(&printLock);
+      pthread_mutex_lock(&pJob->lock);
+      pJob->numValid += valid && !repaired;
+      pJob->numRepaired += repaired;
+      pthread_mutex_unlock(&pJob->lock);
+   }
+}
+
+/**
+ * @brief Determines whether four bytes can be the ID of a subchunk: printable ASCII characters.
+ * 
+ * @param id the four bytes to be checked
+ * @return true if the bytes can be a subchunk ID.
+ *         false otherwise.
+ */
+bool isChunkID(const char* id) {
+   for(int i = 0; i < 4; ++i) {
+      if(id[i] < ' ' || id[i] > '~') {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * @brief Checks the chunk sizes of a .wav file against its length, reading only its RIFF header, 
+ *        the header of every subchunk and the block size in the fmt subchunk. A file whose data
+ *        subchunk runs past the end, or whose sizes were never filled in by a recorder that
+ *        stopped, can be repaired: its data size is cut to the whole frames present, anything
+ *        after them that is not a complete subchunk is cut off, and the RIFF size is rewritten.
+ *        The repair writes only the sizes in place, so the sample data is never copied.
+ * 
+ * @param filename the name of the .wav file to be checked
+ * @param repair whether to repair the file if it can be
+ * @param problems holds a description of everything wrong with the file, empty if nothing is
+ * @param problemsSize the size of problems
+ * @param pRepaired holds whether the file was repaired
+ * @return true if the file is valid or was repaired.
+ *         false otherwise.
+ */
+bool checkHeader(char* filename, bool repair, char* problems, size_t problemsSize, 
+                 bool* pRepaired) {
+#ifdef _WIN32
+   printf("Validation is not supported on this platform.");
+   exit(1);
+#else
+   *pRepaired = false;
+   int filehandle = open(filename, (repair ? O_RDWR : O_RDONLY) | O_BINARY);
+   if(filehandle == -1) {
+      snprintf(problems, problemsSize, "cannot be opened");
+      return false;
+   }
+   off_t fileLength = lseek(filehandle, 0, SEEK_END);
+   size_t length = fileLength > 0 ? (size_t)fileLength : 0;
+   struct riff riff;
+   if(length < sizeof(struct riff) || pread(filehandle, &riff, sizeof(riff), 0) != sizeof(riff) || 
+      strncmp(riff.chunkID, "RIFF", 4) != 0 || strncmp(riff.format, "WAVE", 4) != 0) {
+      snprintf(problems, problemsSize, "not a .wav file");
+      close(filehandle);
+      return false;
+   }
+
+   //Walk the subchunk headers up to the end of the file or the first that does not fit in it
+   size_t position = sizeof(struct riff), end = position, dataStart = 0, dataSize = 0;
+   uint32_t recordedDataSize = 0;
+   short blockAlign = 0;
+   bool foundFormat = false, foundData = false, dataRunsOver = false;
+   while(position < length) {
+      struct data header;
+      bool readable = position + CHUNKHEADERSIZE <= length && 
+                      pread(filehandle, &header, CHUNKHEADERSIZE, position) == CHUNKHEADERSIZE && 
+                      isChunkID(header.subChunk2ID);
+      size_t size = readable ? (uint32_t)header.subChunk2Size : 0;
+      size_t available = readable ? length - position - CHUNKHEADERSIZE : 0;
+      //Whatever follows a data subchunk whose size was never written is its payload, unless it is
+      //a whole subchunk
+      if(foundData && recordedDataSize == 0 && position == dataStart && 
+         (!readable || size > available)) {
+         dataSize = length - dataStart;
+         dataRunsOver = true;
+         end = length;
+         break;
+      }
+      if(!readable) {
+         break;
+      }
+      bool isData = strncmp(header.subChunk2ID, "data", 4) == 0 && !foundData;
+      if(strncmp(header.subChunk2ID, "fmt ", 4) == 0 && size >= FMTSUBCHUNKSIZENOPARAMS) {
+         //The block size follows the format tag, channel count, sample rate and byte rate
+         foundFormat = pread(filehandle, &blockAlign, sizeof(blockAlign), 
+                             position + CHUNKHEADERSIZE + 12) == sizeof(blockAlign);
+      }
+      if(isData) {
+         foundData = true;
+         dataStart = position + CHUNKHEADERSIZE;
+         recordedDataSize = (uint32_t)header.subChunk2Size;
+         dataSize = size;
       }
+      if(size > available) {
+         if(isData) {
+            dataSize = available;
+            dataRunsOver = true;
+            end = length;
+         }
+         break;
+      }
+      position += CHUNKHEADERSIZE + size + (size & 1);
+      end = position < length ? position : length;
+   }
+   if(!foundFormat || blockAlign <= 0 || !foundData) {
+      snprintf(problems, problemsSize, "%s", !foundFormat || blockAlign <= 0 ? 
+                                             "missing or invalid fmt subchunk" : 
+                                             "missing data subchunk");
+      close(filehandle);
+      return false;
+   }
+
+   //The data is cut to whole frames only where it is the last subchunk kept
+   size_t walkedEnd = end;
+   bool partialFrame = false;
+   if(dataStart + dataSize + (dataSize & 1) >= end) {
+      partialFrame = dataSize % blockAlign != 0;
+      dataSize -= dataSize % blockAlign;
+      end = dataStart + dataSize + (dataSize & 1);
+   }
+   size_t used;
+   if(dataRunsOver) {
+      snprintf(problems, problemsSize, "data size %u but %zu bytes present", recordedDataSize, 
+               length - dataStart);
+   }
+   else if(partialFrame) {
+      snprintf(problems, problemsSize, "data ends in a partial frame");
+   }
+   if(walkedEnd < length && !dataRunsOver) {
+      used = strlen(problems);
+      snprintf(problems + used, problemsSize - used, "%s%zu bytes after the last whole subchunk", 
+               used > 0 ? "; " : "", length - walkedEnd);
+   }
+   if(riff.chunkSize != (int)(end - CHUNKHEADERSIZE)) {
+      used = strlen(problems);
+      snprintf(problems + used, problemsSize - used, "%sRIFF size %u, expected %zu", 
+               used > 0 ? "; " : "", (uint32_t)riff.chunkSize, end - CHUNKHEADERSIZE);
+   }
+   if(problems[0] == '\0') {
+      close(filehandle);
+      return true;
+   }
+   if(!repair) {
+      close(filehandle);
+      return false;
+   }
+   if(end - CHUNKHEADERSIZE > UINT32_MAX) {
+      snprintf(problems, problemsSize, "too large for a RIFF file");
+      close(filehandle);
+      return false;
+   }
+
+   //Only the sizes change, and the file is cut or padded to its new end
+   uint32_t newDataSize = (uint32_t)dataSize, newRiffSize = (uint32_t)(end - CHUNKHEADERSIZE);
+   bool written = (newDataSize == recordedDataSize || 
+                   pwrite(filehandle, &newDataSize, sizeof(newDataSize), 
+                          dataStart - sizeof(newDataSize)) == sizeof(newDataSize)) && 
+                  (end == length || ftruncate(filehandle, (off_t)end) == 0) && 
+                  pwrite(filehandle, &newRiffSize, sizeof(newRiffSize), 
+                         sizeof(riff.chunkID)) == sizeof(newRiffSize);
+   close(filehandle);
+   if(!written) {
+      used = strlen(problems);
+      snprintf(problems + used, problemsSize - used, "; error writing the repair");
+      return false;
    }
-   free(temp);
+   *pRepaired = true;
+   return true;
+#endif
 }
 
 /**
- * @brief Opens an output file and writes all of the .wav file data to it.
+ * @brief Opens an output file for writing from its start. With -atomic or -sync the output is
+ *        written to a file with no name, or failing that to "<output name>.tmp", and only takes
+ *        its name when it is closed, so a crash never leaves a half-written file in its place.
  * 
  * @param outputfilename the filename of the desired output file
- * @param pSoundFile a pointer to the wav struct to be written to the file
- * @param parameters the extra parameters to be written to the file
- * @param extraParamsSize the size of the extra parameters to be written to the file
- * @param numExtraSubChunks the number of extra subchunks to be written to the file
- * @param extraChunks the extra subchunks to be written to the file
- */
-void writeOutputFile(char* outputfilename, struct wav* pSoundFile, struct extraParams parameters, 
-                     int extraParamsSize, int numExtraSubChunks, struct data extraChunks[]) {
-   int outputfilehandle = open(outputfilename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+ * @return int the handle of the output file, open for reading and writing
+ */
+int openOutputFile(char* outputfilename) {
+   if(!atomicOutput) {
+      int outputfilehandle = open(outputfilename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+      if(outputfilehandle == -1) {
+         printf("Error creating or opening output file %s", outputfilename);
+         exit(1);
+      }
+      return outputfilehandle;
+   }
+#ifdef _WIN32
+   printf("Atomic output is not supported on this platform.");
+   exit(1);
+#else
+   int outputfilehandle = -1;
+#ifdef O_TMPFILE
+   char* directory = getDirectory(outputfilename);
+   outputfilehandle = open(directory, O_RDWR | O_TMPFILE, 0644);
+   free(directory);
+#endif
+   //File systems without unnamed files get a named one beside the output
+   if(outputfilehandle == -1) {
+      char* tempfilename = getTempFilename(outputfilename);
+      outputfilehandle = open(tempfilename, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0644);
+      free(tempfilename);
+   }
    if(outputfilehandle == -1) {
       printf("Error creating or opening output file %s", outputfilename);
       exit(1);
    }
-   printf("Writing to file %s\n", outputfilename);
-   int bytesWritten = 0;
-   //Write riff and format subchunks
-   bytesWritten += write(outputfilehandle, (char*)(&(pSoundFile->riffElements)), 
-                         sizeof(struct riff));
-   bytesWritten += write(outputfilehandle, (char*)(&(pSoundFile->formatElements)), 
-                         sizeof(struct fmt));
-   //Write extra parameters
-   if(extraParamsSize > 0) {
-      bytesWritten += write(outputfilehandle, (char*)(&parameters), extraParamsSize);
-   }
-   //Write extra subchunks
-   for(int i = 0; i < numExtraSubChunks; i = i + 1) {
-      bytesWritten += write(outputfilehandle, (char*)(&(extraChunks[i])), 
-                            extraChunks[i].subChunk2Size + sizeof(char[4]) + sizeof(int));
-      //                                                      Data ID         Data Size
-   }
-   //Write data subchunk
-   bytesWritten += write(outputfilehandle, (char*)(&(pSoundFile->dataElements)), 
-                        pSoundFile->dataElements.subChunk2Size + sizeof(char[4]) + sizeof(int));
-   printf("Bytes Written: %d\n", bytesWritten);
-   close(outputfilehandle);
-}
\ No newline at end of file
+   return outputfilehandle;
+#endif
+}
+
+/**
+ * @brief Closes a finished output file. With -atomic it takes its name at once. With -sync it is
+ *        held open with the other finished outputs until SYNCGROUPFILES of them are, and the
+ *        whole group is then synced and named together by whichever worker filled it.
+ * 
+ * @param outputfilehandle the handle of the output file
+ * @param outputfilename the filename of the output file
+ */
+void closeOutputFile(int outputfilehandle, char* outputfilename) {
+   if(!atomicOutput) {
+      close(outputfilehandle);
+      return;
+   }
+   if(!syncOutput) {
+      bool published = publishOutputFile(outputfilehandle, outputfilename);
+      close(outputfilehandle);
+      if(!published) {
+         exit(1);
+      }
+      return;
+   }
+   char* filename = strdup(outputfilename);
+   if(!filename) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   //A full group is taken out while the lock is still held, so no other worker adds to it
+   struct outputGroup group;
+   group.numFiles = 0;
+   pthread_mutex_lock(&outputLock);
+   pendingOutputs.filehandles[pendingOutputs.numFiles] = outputfilehandle;
+   pendingOutputs.filenames[pendingOutputs.numFiles++] = filename;
+   if(pendingOutputs.numFiles == SYNCGROUPFILES) {
+      group = pendingOutputs;
+      pendingOutputs.numFiles = 0;
+   }
+   pthread_mutex_unlock(&outputLock);
+   if(group.numFiles > 0 && !commitOutputGroup(&group)) {
+      exit(1);
+   }
+}
+
+/**
+ * @brief Syncs and names every output file still held by -sync.
+ */
+void commitOutputFiles(void) {
+   struct outputGroup group;
+   pthread_mutex_lock(&outputLock);
+   group = pendingOutputs;
+   pendingOutputs.numFiles = 0;
+   pthread_mutex_unlock(&outputLock);
+   if(!commitOutputGroup(&group)) {
+      exit(1);
+   }
+}
+
+/**
+ * @brief Names the finished outputs held by -sync when dWAV exits on an error, so files already
+ *        written in full are not lost with the failed one. Errors here are only reported.
+ */
+void commitOutputFilesAtExit(void) {
+   struct outputGroup group;
+   pthread_mutex_lock(&outputLock);
+   group = pendingOutputs;
+   pendingOutputs.numFiles = 0;
+   pthread_mutex_unlock(&outputLock);
+   commitOutputGroup(&group);
+}
+
+/**
+ * @brief Syncs and names a group of finished output files. Their data is flushed by several
+ *        workers at once, each file with fdatasync, so the device sees one deep queue of writes
+ *        rather than a flush per file. Only then are the files named, and each directory they
+ *        are named in is synced once, so no name ever points at data that is not yet stored. A
+ *        file that cannot be synced keeps whatever was at its name before.
+ * 
+ * @param pGroup a pointer to the group of output files, taken out of pendingOutputs
+ * @return true if every file was synced and named.
+ *         false otherwise.
+ */
+bool commitOutputGroup(struct outputGroup* pGroup) {
+   bool committed = true;
+#ifndef _WIN32
+   if(pGroup->numFiles == 0) {
+      return true;
+   }
+   parallelFor(pGroup->numFiles < SYNCWORKERS ? pGroup->numFiles : SYNCWORKERS, 
+               syncOutputsSlice, pGroup);
+   char* directories[SYNCGROUPFILES];
+   int numDirectories = 0;
+   for(int i = 0; i < pGroup->numFiles; ++i) {
+      bool named = pGroup->synced[i] && 
+                   publishOutputFile(pGroup->filehandles[i], pGroup->filenames[i]);
+      committed = committed && named;
+      close(pGroup->filehandles[i]);
+      char* directory = named ? getDirectory(pGroup->filenames[i]) : NULL;
+      for(int d = 0; d < numDirectories && directory; ++d) {
+         if(strcmp(directories[d], directory) == 0) {
+            free(directory);
+            directory = NULL;
+         }
+      }
+      if(directory) {
+         directories[numDirectories++] = directory;
+      }
+      free(pGroup->filenames[i]);
+   }
+   for(int d = 0; d < numDirectories; ++d) {
+      int directoryhandle = open(directories[d], O_RDONLY | O_DIRECTORY);
+      if(directoryhandle == -1 || fsync(directoryhandle) != 0) {
+         printf("Error syncing directory %s", directories[d]);
+         committed = false;
+      }
+      if(directoryhandle != -1) {
+         close(directoryhandle);
+      }
+      free(directories[d]);
+   }
+   pGroup->numFiles = 0;
+#endif
+   return committed;
+}
+
+/**
+ * @brief Flushes one worker's share of a group of output files to the device.
+ * 
+ * @param pGroup a pointer to the outputGroup struct being synced
+ * @param worker the index of the worker
+ * @param numWorkers the number of workers syncing files
+ */
+void syncOutputsSlice(void* pGroup, int worker, int numWorkers) {
+#ifndef _WIN32
+   struct outputGroup* pJob = (struct outputGroup*)pGroup;
+   for(int i = worker; i < pJob->numFiles; i += numWorkers) {
+      pJob->synced[i] = fdatasync(pJob->filehandles[i]) == 0;
+      if(!pJob->synced[i]) {
+         pthread_mutex_lock(&printLock);
+         printf("Error syncing output file %s", pJob->filenames[i]);
+         pthread_mutex_unlock(&printLock);
+      }
+   }
+#endif
+}
+
+/**
+ * @brief Gives a finished output file its name, replacing any file already there in one step. An
+ *        unnamed file is first linked in as "<output name>.tmp", then renamed.
+ * 
+ * @param outputfilehandle the handle of the output file
+ * @param outputfilename the filename the output file takes
+ * @return true if the file was named.
+ *         false otherwise.
+ */
+bool publishOutputFile(int outputfilehandle, char* outputfilename) {
+#ifndef _WIN32
+   char* tempfilename = getTempFilename(outputfilename);
+   struct stat status;
+   bool linked = fstat(outputfilehandle, &status) == 0 && status.st_nlink > 0;
+   if(!linked) {
+      char procPath[64];
+      snprintf(procPath, sizeof(procPath), "/proc/self/fd/%d", outputfilehandle);
+      unlink(tempfilename); //A stale file left by a crash
+      linked = linkat(AT_FDCWD, procPath, AT_FDCWD, tempfilename, AT_SYMLINK_FOLLOW) == 0;
+   }
+   bool named = linked && rename(tempfilename, outputfilename) == 0;
+   free(tempfilename);
+   if(!named) {
+      printf("Error naming output file %s", outputfilename);
+   }
+   return named;
+#else
+   return false;
+#endif
+}
+
+/**
+ * @brief Builds the name of the file an output is written to before it takes its own name.
+ * 
+ * @param outputfilename the filename of the output file
+ * @return char* the newly allocated temporary filename
+ */
+char* getTempFilename(char* outputfilename) {
+   char* tempfilename = (char*)malloc(strlen(outputfilename) + sizeof(TEMPEXTENSION));
+   if(!tempfilename) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   sprintf(tempfilename, "%s" TEMPEXTENSION, outputfilename);
+   return tempfilename;
+}
+
+/**
+ * @brief Finds the directory a file is in, from its name alone.
+ * 
+ * @param filename the name of the file
+ * @return char* the newly allocated name of the directory, "." if the name has none
+ */
+char* getDirectory(char* filename) {
+   char* slash = strrchr(filename, '/');
+   size_t length = slash ? (slash == filename ? 1 : (size_t)(slash - filename)) : 1;
+   char* directory = (char*)malloc(length + 1);
+   if(!directory) {
+      printf("Error in allocating memory.");
+      exit(1);
+   }
+   memcpy(directory, slash ? filename : ".", length);
+   directory[length] = '\0';
+   return directory;
+}